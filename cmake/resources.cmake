@@ -17,19 +17,20 @@ endif()
 function(add_shaders target shaderdirs)
 	foreach(GLSL ${shaderdirs})
 		get_filename_component(FILE_NAME ${GLSL} NAME)
+		get_filename_component(GLSL_PATH ${GLSL} ABSOLUTE BASE_DIR ${CMAKE_CURRENT_SOURCE_DIR})
 		set(SPIRV "${CMAKE_CURRENT_BINARY_DIR}/shaders/${FILE_NAME}.spv")
 		add_custom_command(
 			OUTPUT ${SPIRV}
 			COMMAND ${CMAKE_COMMAND} -E make_directory "${CMAKE_CURRENT_BINARY_DIR}/shaders/"
-			COMMAND ${GLSL_VALIDATOR} -V ${CMAKE_CURRENT_SOURCE_DIR}/${GLSL} -o ${SPIRV}
-			DEPENDS ${GLSL}
+			COMMAND ${GLSL_VALIDATOR} -V ${GLSL_PATH} -o ${SPIRV}
+			DEPENDS ${GLSL_PATH}
 		)
 
 		list(APPEND SPIRV_BINARY_FILES ${SPIRV})
 	endforeach(GLSL)
 
-	add_custom_target(shaders DEPENDS ${SPIRV_BINARY_FILES})
-	add_dependencies(${target} shaders)
+	add_custom_target(${target}_shaders DEPENDS ${SPIRV_BINARY_FILES})
+	add_dependencies(${target} ${target}_shaders)
 
 	add_custom_command(TARGET ${target} POST_BUILD
 		COMMAND ${CMAKE_COMMAND} -E make_directory "$<TARGET_FILE_DIR:${target}>/shaders/"
@@ -9,10 +9,13 @@
 #include "pch.hpp"
 
 #include <cassert>
+#include <spdlog/async.h>
 #include <spdlog/fmt/fmt.h>
 #include <spdlog/sinks/basic_file_sink.h>
 #include <spdlog/sinks/stdout_color_sinks.h>
 
+#include "gfx/vkutl.hpp"
+#include "gfx/device.hpp"
 #include "gfx/context.hpp"
 #include "gfx/swapchain.hpp"
 
@@ -21,6 +24,14 @@ namespace idio
 	Logger s_EngineLogger = nullptr;
 	Application *Application::s_Instance = nullptr;
 
+	// Longer gaps (breakpoints, window drags, hitches) aren't simulated at all
+	constexpr auto k_MaxSimDelta = std::chrono::milliseconds(250);
+	// close() and invalidate() wake the loop themselves, this only bounds a missed wake up
+	constexpr int32_t k_IdleTimeoutMs = 100;
+	// Messages waiting for the log thread, the oldest are overwritten when it falls behind
+	constexpr size_t k_LogQueueSize = 8192;
+	constexpr auto k_LogFlushInterval = std::chrono::seconds(2);
+
 	Application::Application(std::string name, Version v, const WindowCreateInfo &wci) :
 		m_version(v), m_name(std::move(name)), m_windowCreateInfo(wci)
 	{
@@ -30,25 +41,61 @@ namespace idio
 
 	void Application::run()
 	{
-		m_mainWindow = std::make_unique<Window>(m_windowCreateInfo);
-		m_context = std::make_unique<Context>(m_version, m_name, *m_mainWindow);
+		m_mainWindow = m_windows.emplace_back(std::make_unique<Window>(m_windowCreateInfo)).get();
+		m_context = std::make_unique<Context>(m_version, m_name, *m_mainWindow, m_maxFramesInFlight);
 		m_mainWindow->create_swapchain(*m_context);
+		update_limiter();
+
+		// IDIO_METRICS=csv or json dumps engine metrics next to the log
+		if(const char *env = std::getenv("IDIO_METRICS")) {
+			const std::string_view format(env);
+			if(format == "csv" || format == "json") {
+				set_metrics_dump(fmt::format("{}/metrics.{}", m_prefpath, format),
+					format == "json" ? MetricsFormat::Json : MetricsFormat::Csv);
+			} else {
+				s_EngineLogger->warn("Unknown IDIO_METRICS format {}, expected csv or json", format);
+			}
+		}
+		m_wakeEvent = SDL_RegisterEvents(1);
 		init();
 
-		bool minimised = false;
+		m_packets = std::make_unique<FramePipe>(m_renderThread ? 2 : 1, m_framePacketSize);
+		if(m_renderThread) {
+			m_renderer = std::thread(&Application::render_thread, this);
+		}
+
+		m_lastSim = Clock::now();
 		while(m_open) {
-			if(!minimised) {
-				if(!m_mainWindow->clear()) {
-					recreate_pipelines();
-					continue;
+			if(m_simRate != 0) {
+				simulate();
+			}
+
+			const bool visible = std::any_of(m_windows.begin(), m_windows.end(),
+				[](const std::unique_ptr<Window> &w) { return !w->is_minimised(); });
+			const bool render = visible && (!m_renderOnDemand || m_invalid.exchange(false));
+			if(render) {
+				if(m_renderThread) {
+					// Blocks while the render thread is still on the previous packet and one more is queued
+					auto &p = m_packets->begin_build();
+					p.m_alpha = m_simAlpha;
+					build_packet(p);
+					m_packets->end_build(p);
+				} else {
+					frame(nullptr);
 				}
 
-				tick();
+				// Sleeping before polling means the next frame starts with the freshest input
+				m_limiter.wait();
 			}
 
-			// I know...
+			// Nothing to draw, so block until there's an event or a simulation step is due
 			SDL_Event sdlEvt;
-			while(SDL_PollEvent(&sdlEvt)) {
+			bool pending = render ? SDL_PollEvent(&sdlEvt) != 0 : SDL_WaitEventTimeout(&sdlEvt, get_idle_timeout()) != 0;
+			for(; pending; pending = SDL_PollEvent(&sdlEvt) != 0) {
+				if(m_renderOnDemand) {
+					m_invalid = true;
+				}
+
 				auto evt = translate_evt(sdlEvt);
 				bool handled = evt_handler(
 					evt,
@@ -58,24 +105,38 @@ namespace idio
 					},
 
 					[&](const WindowMinimiseEvent &me) -> bool {
-						if(me.id == m_mainWindow->get_id()) {
-							minimised = me.minimised;
+						if(auto w = find_window(me.id)) {
+							sync_render();
+							w->set_minimised(me.minimised);
 							return true;
 						}
 
 						return false;
 					},
 					[&](const WindowClosedEvent &wce) -> bool {
-						if(wce.id == m_mainWindow->get_id()) {
-							m_open = false;
+						if(auto w = find_window(wce.id)) {
+							if(w != m_mainWindow) {
+								event_proc(evt);
+							}
+
+							close_window(*w);
 							return true;
 						}
 
 						return false;
 					},
+					[&](const WindowFocusEvent &wfe) -> bool {
+						if(auto w = find_window(wfe.id)) {
+							w->set_focus(wfe.focused);
+							update_limiter();
+						}
+
+						return false;
+					},
 					[&](const WindowResizeEvent &wre) -> bool {
-						if(wre.id == m_mainWindow->get_id()) {
-							m_mainWindow->create_swapchain(*m_context);
+						if(auto w = find_window(wre.id)) {
+							sync_render();
+							w->create_swapchain(*m_context);
 							recreate_pipelines();
 							return true;
 						}
@@ -88,11 +149,238 @@ namespace idio
 				}
 			}
 		}
+
+		if(m_renderer.joinable()) {
+			m_packets->close();
+			m_renderer.join();
+			m_context->set_frame_thread({});
+		}
+	}
+
+	void Application::tick()
+	{
+		// Apps written against packets run unchanged without the render thread
+		auto &p = m_packets->begin_build();
+		p.m_alpha = m_simAlpha;
+		build_packet(p);
+		m_packets->end_build(p);
+		auto rp = m_packets->begin_render();
+		render_packet(*rp);
+		m_packets->end_render(*rp);
+	}
+
+	void Application::render_thread()
+	{
+		m_context->set_frame_thread(std::this_thread::get_id());
+		while(auto p = m_packets->begin_render()) {
+			frame(p);
+			m_packets->end_render(*p);
+		}
+	}
+
+	void Application::simulate()
+	{
+		const auto step = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(1.0 / m_simRate));
+		const auto now = Clock::now();
+		m_simAccum += std::min<Clock::duration>(now - m_lastSim, k_MaxSimDelta);
+		m_lastSim = now;
+
+		const float dt = 1.0f / static_cast<float>(m_simRate);
+		uint32_t steps = 0;
+		while(m_simAccum >= step && steps < m_maxSimSteps) {
+			fixed_tick(dt);
+			m_simAccum -= step;
+			steps++;
+		}
+
+		// Simulation costs more than it covers, catching up would only make the next frame later
+		if(m_simAccum >= step) {
+			s_EngineLogger->debug("Simulation fell behind, dropping {} steps", m_simAccum / step);
+			m_simAccum %= step;
+		}
+
+		m_simAlpha = static_cast<float>(std::chrono::duration<double>(m_simAccum) / std::chrono::duration<double>(step));
+	}
+
+	int32_t Application::get_idle_timeout() const
+	{
+		if(m_simRate == 0) {
+			return k_IdleTimeoutMs;
+		}
+
+		const auto step = std::chrono::duration<double>(1.0 / m_simRate);
+		const auto due = step - std::chrono::duration<double>(m_simAccum + (Clock::now() - m_lastSim));
+		const auto ms = std::chrono::ceil<std::chrono::milliseconds>(due).count();
+		return static_cast<int32_t>(std::clamp<int64_t>(ms, 0, k_IdleTimeoutMs));
+	}
+
+	void Application::sync_render()
+	{
+		if(m_renderer.joinable()) {
+			m_packets->wait_idle();
+		}
+	}
+
+	void Application::frame(const FramePacket *packet)
+	{
+		m_context->begin_frame();
+
+		// Every acquired image has to be presented, so windows that fail to acquire sit this frame out
+		bool recreated = false;
+		m_frameWindows.clear();
+		for(auto &w : m_windows) {
+			if(w->is_minimised()) {
+				continue;
+			}
+
+			if(w->clear()) {
+				m_frameWindows.push_back(w.get());
+			} else {
+				recreated = true;
+			}
+		}
+
+		if(recreated) {
+			recreate_pipelines();
+		}
+
+		if(m_frameWindows.empty()) {
+			return;
+		}
+
+		m_frameSubmitted = false;
+		if(packet) {
+			render_packet(*packet);
+		} else {
+			tick();
+		}
+
+		if(!m_frameSubmitted) {
+			s_EngineLogger->critical("Frame acquired {} windows but never called submit_frame", m_frameWindows.size());
+			Application::crash();
+		}
+
+		m_context->flush_submits();
+		Swapchain::present(*m_context, get_frame_swapchains());
+		m_context->end_frame();
+	}
+
+	void Application::submit_frame(std::span<const vk::CommandBuffer> cbufs, std::span<const vk::Semaphore> computeWaits)
+	{
+		m_context->enqueue_frame(get_frame_swapchains(), cbufs, computeWaits);
+		m_frameSubmitted = true;
+	}
+
+	std::span<Swapchain *const> Application::get_frame_swapchains()
+	{
+		auto scs = m_context->get_frame_arena().alloc<Swapchain *>(m_frameWindows.size());
+		std::transform(m_frameWindows.begin(), m_frameWindows.end(), scs.begin(),
+			[](const Window *w) { return &w->get_swapchain(); });
+		return scs;
+	}
+
+	Window &Application::open_window(const WindowCreateInfo &wci)
+	{
+		sync_render();
+		auto &w = m_windows.emplace_back(std::make_unique<Window>(wci));
+		w->create_swapchain(*m_context);
+		return *w;
+	}
+
+	void Application::close_window(Window &w)
+	{
+		if(&w == m_mainWindow) {
+			m_open = false;
+			return;
+		}
+
+		// Its swapchain may still be presenting
+		sync_render();
+		check_vk(m_context->get_device().waitIdle(), "Failed to wait for window to close");
+		std::erase_if(m_windows, [&w](const std::unique_ptr<Window> &o) { return o.get() == &w; });
+	}
+
+	Window *Application::find_window(uint32_t id) const
+	{
+		auto it = std::find_if(m_windows.begin(), m_windows.end(),
+			[id](const std::unique_ptr<Window> &w) { return w->get_id() == id; });
+		return it == m_windows.end() ? nullptr : it->get();
+	}
+
+	void Application::set_present_policy(PresentPolicy p, uint32_t maxFps)
+	{
+		if(p == PresentPolicy::Capped && maxFps == 0) {
+			s_EngineLogger->warn("Capped present policy without a frame rate, running uncapped");
+		}
+
+		sync_render();
+		m_mainWindow->set_present_policy(p, maxFps);
+		m_mainWindow->create_swapchain(*m_context);
+		recreate_pipelines();
+		update_limiter();
+	}
+
+	void Application::update_limiter()
+	{
+		uint32_t fps = 0;
+		switch(m_mainWindow->get_present_policy()) {
+		case PresentPolicy::Capped:
+			fps = m_mainWindow->get_max_fps();
+			break;
+		case PresentPolicy::LowLatency:
+			// Present wait paces this in the swapchain, without it don't render frames mailbox will throw away
+			if(!m_context->get_features().presentWait) {
+				fps = m_mainWindow->get_refresh_rate();
+			}
+			break;
+		default:
+			break;
+		}
+
+		const bool focused = std::any_of(m_windows.begin(), m_windows.end(),
+			[](const std::unique_ptr<Window> &w) { return w->has_focus(); });
+		if(!focused && m_backgroundFps != 0) {
+			fps = fps == 0 ? m_backgroundFps : std::min(fps, m_backgroundFps);
+		}
+
+		m_limiter.set_max_fps(fps);
+	}
+
+	void Application::set_background_fps(uint32_t fps)
+	{
+		m_backgroundFps = fps;
+		if(m_mainWindow) {
+			update_limiter();
+		}
+	}
+
+	void Application::set_render_on_demand(bool onDemand)
+	{
+		m_renderOnDemand = onDemand;
+		invalidate();
+	}
+
+	void Application::invalidate()
+	{
+		// Only the first request needs to wake the event loop
+		if(!m_invalid.exchange(true)) {
+			wake_event_loop();
+		}
+	}
+
+	void Application::wake_event_loop()
+	{
+		if(m_wakeEvent != std::numeric_limits<uint32_t>::max()) {
+			SDL_Event evt {};
+			evt.type = m_wakeEvent;
+			SDL_PushEvent(&evt);
+		}
 	}
 
 	void Application::close()
 	{
 		s_Instance->m_open = false;
+		s_Instance->wake_event_loop();
 	}
 
 	Application &Application::get()
@@ -104,7 +392,8 @@ namespace idio
 	{
 		SDL_ShowSimpleMessageBox(SDL_MESSAGEBOX_ERROR, "Error", "Critical error :) (Check logs)", nullptr);
 		s_EngineLogger->critical("Whoopsie we crashed! Check the logs :)");
-		s_EngineLogger->flush();
+		// Destroys the log thread pool, which writes out everything still queued before returning
+		spdlog::shutdown();
 		std::terminate();
 	}
 
@@ -120,9 +409,17 @@ namespace idio
 		sinks[0]->set_pattern("%^[%T] %n: %v%$");
 		sinks[1]->set_pattern("[%T] [%l] %n: %v");
 
-		auto hdl = std::make_shared<spdlog::logger>(name, sinks.begin(), sinks.end());
+		// Formatting and file writes happen on the log thread, the caller only queues the message
+		static std::once_flag init;
+		std::call_once(init, []() {
+			spdlog::init_thread_pool(k_LogQueueSize, 1);
+			spdlog::flush_every(k_LogFlushInterval);
+		});
+
+		auto hdl = std::make_shared<spdlog::async_logger>(name, sinks.begin(), sinks.end(), spdlog::thread_pool(),
+			spdlog::async_overflow_policy::overrun_oldest);
 		spdlog::register_logger(hdl);
-		hdl->flush_on(spdlog::level::trace);
+		hdl->flush_on(spdlog::level::warn);
 		if constexpr(ID_DEBUG) {
 			hdl->set_level(spdlog::level::trace);
 		} else {
@@ -158,6 +455,7 @@ namespace idio
 
 		void deinit_engine()
 		{
+			spdlog::shutdown();
 			SDL_Quit();
 		}
 	}
@@ -11,6 +11,9 @@
 
 #include "types.hpp"
 #include "event.hpp"
+#include "timing.hpp"
+#include "memory.hpp"
+#include "packet.hpp"
 #include "window.hpp"
 
 namespace idio
@@ -28,27 +31,103 @@ namespace idio
 		void run();
 		virtual void event_proc(const Event &e) = 0;
 
+		// Recreates the main window's swapchain and the app's pipelines to match
+		void set_present_policy(PresentPolicy p, uint32_t maxFps = 0);
+		// Frame rate cap while none of the windows have focus, 0 keeps the present policy's
+		void set_background_fps(uint32_t fps);
+
+		// Only render after an input event or invalidate(), otherwise the main loop sleeps in the event queue.
+		// Simulation keeps its rate, fixed_tick should invalidate when it changes anything visible.
+		void set_render_on_demand(bool onDemand);
+		// Requests a frame in render on demand mode, safe from any thread
+		void invalidate();
+
+		// Extra windows, available from init() on. Closing the main window quits, any other window
+		// is destroyed after event_proc has seen its WindowClosedEvent.
+		Window &open_window(const WindowCreateInfo &wci);
+		void close_window(Window &w);
+		Window *find_window(uint32_t id) const;
+
 		std::string get_name() const { return m_name; }
 		std::string get_pref_dir() const { return m_prefpath; }
 
+		// Safe from any thread
 		static void close();
 		static Application &get();
 		[[noreturn]] static void crash() noexcept;
 	protected:
-		bool m_open = true;
+		std::atomic<bool> m_open { true }; // Cleared by close() from any thread
 		Version m_version;
 		std::string m_name;
 		std::string m_prefpath;
 
 		const WindowCreateInfo m_windowCreateInfo;
+		// Set before run(), later changes go through Context::set_frames_in_flight up to this
+		uint32_t m_maxFramesInFlight = s_DefaultFramesInFlight;
+		// Set before run(). The main thread then only handles events and build_packet, while a
+		// render thread acquires, calls render_packet, submits and presents one frame behind.
+		bool m_renderThread = false;
+		size_t m_framePacketSize = 1024 * 1024;
+		// Set before run(). fixed_tick runs this many times a second independent of the frame rate,
+		// 0 leaves all simulation to the per-frame callbacks. A frame runs at most m_maxSimSteps
+		// steps, past that the backlog is dropped rather than letting each frame fall further behind.
+		uint32_t m_simRate = 0;
+		uint32_t m_maxSimSteps = 8;
 		Logger m_gameLogger;
 		std::unique_ptr<Context> m_context;
-		std::unique_ptr<Window> m_mainWindow;
+		std::vector<std::unique_ptr<Window>> m_windows;
+		Window *m_mainWindow = nullptr; // Always m_windows[0]
+		FrameLimiter m_limiter;
 
 		virtual void init() = 0;
-		virtual void tick() = 0;
+		// Main thread, dt is always 1 / m_simRate seconds
+		virtual void fixed_tick(float dt) {}
+		// A whole frame on one thread, only called without m_renderThread. The default builds a packet and renders it.
+		virtual void tick();
 		virtual void recreate_pipelines() = 0;
+
+		// build_packet copies whatever render_packet reads into the packet, render_packet records it and calls
+		// submit_frame. With m_renderThread they overlap, so render_packet may only touch the packet, gpu
+		// objects and its own state, and build_packet can't use the Context frame arena. Anything that enqueues
+		// or records gpu work (AssetStreamer::pump, BufferPool allocation, uploads) goes in render_packet too,
+		// debug builds crash when build_packet enqueues.
+		virtual void build_packet(FramePacket &p) {}
+		virtual void render_packet(const FramePacket &p) {}
+		// Interpolation alpha for tick(), packets carry their own
+		float get_sim_alpha() const noexcept { return m_simAlpha; }
+
+		// Windows whose images were acquired this frame, tick() renders to each of them and
+		// hands everything to submit_frame. Once tick() returns all enqueued work is flushed,
+		// one submission per queue, and the frame is presented to all of them at once.
+		std::span<Window *const> get_frame_windows() const { return m_frameWindows; }
+		void submit_frame(std::span<const vk::CommandBuffer> cbufs, std::span<const vk::Semaphore> computeWaits = {});
 	private:
+		std::vector<Window *> m_frameWindows;
+		bool m_frameSubmitted = false;
+		std::unique_ptr<FramePipe> m_packets;
+		std::thread m_renderer;
+
+		uint32_t m_backgroundFps = 0;
+		bool m_renderOnDemand = false;
+		std::atomic<bool> m_invalid { true };
+		uint32_t m_wakeEvent = std::numeric_limits<uint32_t>::max(); // Registered in run()
+
+		Clock::time_point m_lastSim {};
+		Clock::duration m_simAccum {};
+		float m_simAlpha = 1.0f;
+
+		void frame(const FramePacket *packet);
+		void render_thread();
+		void simulate();
+		// Longest the event loop can sleep without delaying the next simulation step
+		int32_t get_idle_timeout() const;
+		// Breaks the event loop out of SDL_WaitEventTimeout
+		void wake_event_loop();
+		// Waits for the render thread to finish every queued packet before windows or swapchains change
+		void sync_render();
+		void update_limiter();
+		std::span<Swapchain *const> get_frame_swapchains();
+
 		static Application *s_Instance;
 
 		friend void internal::init_engine();
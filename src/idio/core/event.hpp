@@ -50,8 +50,14 @@ namespace idio
 		bool minimised;
 	};
 
+	struct WindowFocusEvent
+	{
+		uint32_t id;
+		bool focused;
+	};
+
 	using Event = std::variant<NoEvent, QuitEvent,
-		WindowClosedEvent, WindowMinimiseEvent, WindowResizeEvent>;
+		WindowClosedEvent, WindowMinimiseEvent, WindowResizeEvent, WindowFocusEvent>;
 
 	template<typename... Handlers>
 	auto evt_handler(const Event &e, Handlers &&...h)
@@ -83,6 +89,13 @@ namespace idio
 					.minimised = true
 				};
 				break;
+			case SDL_WINDOWEVENT_FOCUS_GAINED:
+			case SDL_WINDOWEVENT_FOCUS_LOST:
+				translatedEvent = WindowFocusEvent {
+					.id = sdlEvt.window.windowID,
+					.focused = sdlEvt.window.event == SDL_WINDOWEVENT_FOCUS_GAINED
+				};
+				break;
 			case SDL_WINDOWEVENT_RESIZED:
 				translatedEvent = WindowResizeEvent {
 					.id = sdlEvt.window.windowID,
@@ -0,0 +1,34 @@
+/**
+ * Copyright (c) 2022 Connor Mellon
+ * 
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+#ifndef IDIO_CORE_FILE_H
+#define IDIO_CORE_FILE_H
+
+namespace idio
+{
+	// Read only view of a whole file, mapped by the OS so pages are only read in when touched.
+	// Implemented per platform in linux.cpp / win32.cpp.
+	class MappedFile
+	{
+	public:
+		explicit MappedFile(const std::string &pth);
+		~MappedFile();
+		MappedFile(const MappedFile &o) = delete;
+		MappedFile &operator=(const MappedFile &o) = delete;
+
+		// False for empty files too, they can't be mapped
+		bool is_open() const noexcept { return m_data != nullptr; }
+		std::span<const std::byte> get_data() const noexcept { return { m_data, m_size }; }
+		size_t size() const noexcept { return m_size; }
+	private:
+		const std::byte *m_data = nullptr;
+		size_t m_size = 0;
+	};
+}
+
+#endif
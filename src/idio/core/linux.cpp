@@ -6,8 +6,49 @@
  * file, You can obtain one at http://mozilla.org/MPL/2.0/.
  */
 
+#include "pch.hpp"
+#include "file.hpp"
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
 extern void idio_main(int argc, char **argv);
 
+namespace idio
+{
+	MappedFile::MappedFile(const std::string &pth)
+	{
+		int fd = open(pth.c_str(), O_RDONLY | O_CLOEXEC);
+		if(fd < 0) {
+			s_EngineLogger->warn("Failed to open {}", pth);
+			return;
+		}
+
+		struct stat st {};
+		if(fstat(fd, &st) == 0 && st.st_size > 0) {
+			void *ptr = mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+			if(ptr != MAP_FAILED) {
+				m_data = static_cast<const std::byte *>(ptr);
+				m_size = static_cast<size_t>(st.st_size);
+			} else {
+				s_EngineLogger->warn("Failed to map {}", pth);
+			}
+		}
+
+		// The mapping keeps its own reference to the file
+		close(fd);
+	}
+
+	MappedFile::~MappedFile()
+	{
+		if(m_data) {
+			munmap(const_cast<std::byte *>(m_data), m_size);
+		}
+	}
+}
+
 int main(int argc, char **argv)
 {
 	idio_main(argc, argv);
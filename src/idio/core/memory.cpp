@@ -0,0 +1,65 @@
+/**
+ * Copyright (c) 2022 Connor Mellon
+ * 
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+#include "pch.hpp"
+#include "memory.hpp"
+
+#include <atomic>
+#include <cstdlib>
+
+namespace
+{
+	std::atomic<uint64_t> s_HeapAllocations = 0;
+}
+
+#if ID_DEBUG
+void *operator new(size_t sz)
+{
+	s_HeapAllocations.fetch_add(1, std::memory_order_relaxed);
+	if(void *p = std::malloc(sz == 0 ? 1 : sz)) {
+		return p;
+	}
+
+	throw std::bad_alloc();
+}
+
+void operator delete(void *p) noexcept
+{
+	std::free(p);
+}
+
+void operator delete(void *p, size_t) noexcept
+{
+	std::free(p);
+}
+#endif
+
+namespace idio
+{
+	LinearArena::LinearArena(size_t capacity) :
+		m_data(std::make_unique<std::byte[]>(capacity)), m_capacity(capacity)
+	{
+	}
+
+	void *LinearArena::alloc_raw(size_t sz, size_t align)
+	{
+		const size_t start = (m_head + align - 1) & ~(align - 1);
+		if(start + sz > m_capacity) {
+			s_EngineLogger->critical("Linear arena exhausted ({} of {} bytes used, {} requested)", m_head, m_capacity, sz);
+			Application::crash();
+		}
+
+		m_head = start + sz;
+		return m_data.get() + start;
+	}
+
+	uint64_t heap_allocation_count() noexcept
+	{
+		return s_HeapAllocations.load(std::memory_order_relaxed);
+	}
+}
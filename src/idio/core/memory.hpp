@@ -0,0 +1,47 @@
+/**
+ * Copyright (c) 2022 Connor Mellon
+ * 
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+#ifndef IDIO_CORE_MEMORY_H
+#define IDIO_CORE_MEMORY_H
+
+namespace idio
+{
+	// Bump allocator for scratch data that only lives until the next reset().
+	// Only trivially destructible types, nothing is ever destroyed.
+	class LinearArena
+	{
+	public:
+		explicit LinearArena(size_t capacity);
+		LinearArena(const LinearArena &o) = delete;
+		LinearArena &operator=(const LinearArena &o) = delete;
+
+		template<typename T>
+		std::span<T> alloc(size_t count)
+		{
+			static_assert(std::is_trivially_destructible_v<T>);
+			T *ptr = static_cast<T *>(alloc_raw(sizeof(T) * count, alignof(T)));
+			std::uninitialized_value_construct_n(ptr, count);
+			return std::span<T>(ptr, count);
+		}
+
+		void reset() noexcept { m_head = 0; }
+		size_t get_used() const noexcept { return m_head; }
+		size_t get_capacity() const noexcept { return m_capacity; }
+	private:
+		std::unique_ptr<std::byte[]> m_data;
+		size_t m_capacity;
+		size_t m_head = 0;
+
+		void *alloc_raw(size_t sz, size_t align);
+	};
+
+	// Number of global operator new calls so far. Only counted in debug builds.
+	uint64_t heap_allocation_count() noexcept;
+}
+
+#endif
@@ -0,0 +1,203 @@
+/**
+ * Copyright (c) 2022 Connor Mellon
+ * 
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+#include "pch.hpp"
+#include "metrics.hpp"
+
+#include <fstream>
+#include <spdlog/fmt/fmt.h>
+
+namespace idio
+{
+	namespace
+	{
+		struct ThreadCounters
+		{
+			std::array<std::atomic<uint64_t>, s_MaxMetrics> values {};
+
+			ThreadCounters();
+			~ThreadCounters();
+		};
+
+		struct Registry
+		{
+			std::mutex mutex;
+			std::vector<std::string> names;
+			std::vector<MetricKind> kinds;
+			std::array<std::atomic<double>, s_MaxMetrics> gauges {};
+			std::vector<ThreadCounters *> threads;
+			std::array<uint64_t, s_MaxMetrics> retired {}; // Left behind by threads that exited
+
+			MetricsSnapshot snapshot;
+			std::ofstream dump;
+			MetricsFormat dumpFormat = MetricsFormat::Csv;
+			uint32_t dumpInterval = 0;
+			size_t dumpColumns = 0; // Csv header is rewritten when metrics are added
+
+			Registry()
+			{
+				names.reserve(s_MaxMetrics);
+				kinds.reserve(s_MaxMetrics);
+				names = {
+					"draw_calls", "pipeline_binds", "buffer_upload_bytes", "submits", "swapchain_recreations",
+					"fence_wait_us", "heap_allocations", "frame_time_ms", "frame_latency_ms"
+				};
+				kinds.assign(names.size(), MetricKind::Counter);
+				kinds[static_cast<size_t>(EngineMetric::FrameTime)] = MetricKind::Gauge;
+				kinds[static_cast<size_t>(EngineMetric::FrameLatency)] = MetricKind::Gauge;
+				static_assert(static_cast<size_t>(EngineMetric::Count) == 9);
+			}
+
+			void write_dump();
+		};
+
+		Registry &registry()
+		{
+			static Registry r;
+			return r;
+		}
+
+		thread_local ThreadCounters t_Counters;
+
+		ThreadCounters::ThreadCounters()
+		{
+			auto &r = registry();
+			std::lock_guard lock(r.mutex);
+			r.threads.push_back(this);
+		}
+
+		ThreadCounters::~ThreadCounters()
+		{
+			auto &r = registry();
+			std::lock_guard lock(r.mutex);
+			for(size_t i = 0; i < s_MaxMetrics; i++) {
+				r.retired[i] += values[i].load(std::memory_order_relaxed);
+			}
+			std::erase(r.threads, this);
+		}
+
+		void Registry::write_dump()
+		{
+			if(dumpFormat == MetricsFormat::Csv) {
+				if(dumpColumns != snapshot.samples.size()) {
+					dump << "frame";
+					for(auto &s : snapshot.samples) {
+						dump << ',' << s.name;
+					}
+					dump << '\n';
+					dumpColumns = snapshot.samples.size();
+				}
+
+				dump << snapshot.frame;
+				for(auto &s : snapshot.samples) {
+					dump << fmt::format(",{}", s.value);
+				}
+				dump << '\n';
+			} else {
+				dump << fmt::format("{{\"frame\":{}", snapshot.frame);
+				for(auto &s : snapshot.samples) {
+					dump << fmt::format(",\"{}\":{}", s.name, s.value);
+				}
+				dump << "}\n";
+			}
+		}
+	}
+
+	MetricId register_metric(std::string_view name, MetricKind kind)
+	{
+		auto &r = registry();
+		std::lock_guard lock(r.mutex);
+		auto it = std::find(r.names.begin(), r.names.end(), name);
+		if(it != r.names.end()) {
+			return static_cast<MetricId>(it - r.names.begin());
+		}
+
+		if(r.names.size() == s_MaxMetrics) {
+			s_EngineLogger->critical("Too many metrics registered (adding {})", name);
+			Application::crash();
+		}
+
+		r.names.emplace_back(name);
+		r.kinds.push_back(kind);
+		return static_cast<MetricId>(r.names.size() - 1);
+	}
+
+	void count_metric(MetricId id, uint64_t n) noexcept
+	{
+		if(id < s_MaxMetrics) {
+			t_Counters.values[id].fetch_add(n, std::memory_order_relaxed);
+		}
+	}
+
+	void set_metric(MetricId id, double value) noexcept
+	{
+		if(id < s_MaxMetrics) {
+			registry().gauges[id].store(value, std::memory_order_relaxed);
+		}
+	}
+
+	void collect_metrics(uint64_t frame)
+	{
+		auto &r = registry();
+		std::lock_guard lock(r.mutex);
+		r.snapshot.frame = frame;
+		r.snapshot.samples.resize(r.names.size());
+		for(size_t i = 0; i < r.names.size(); i++) {
+			double value = 0.0;
+			if(r.kinds[i] == MetricKind::Counter) {
+				uint64_t sum = std::exchange(r.retired[i], 0);
+				for(auto t : r.threads) {
+					sum += t->values[i].exchange(0, std::memory_order_relaxed);
+				}
+				value = static_cast<double>(sum);
+			} else {
+				value = r.gauges[i].load(std::memory_order_relaxed);
+			}
+
+			r.snapshot.samples[i] = MetricSample { r.names[i], r.kinds[i], value };
+		}
+
+		if(r.dumpInterval != 0 && frame % r.dumpInterval == 0) {
+			r.write_dump();
+		}
+	}
+
+	const MetricsSnapshot &get_metrics_snapshot()
+	{
+		return registry().snapshot;
+	}
+
+	MetricsSnapshot copy_metrics_snapshot()
+	{
+		auto &r = registry();
+		std::lock_guard lock(r.mutex);
+		return r.snapshot;
+	}
+
+	void set_metrics_dump(const std::string &path, MetricsFormat format, uint32_t intervalFrames)
+	{
+		auto &r = registry();
+		std::lock_guard lock(r.mutex);
+		r.dump = std::ofstream();
+		r.dumpInterval = 0;
+		r.dumpColumns = 0;
+		if(path.empty()) {
+			return;
+		}
+
+		r.dump.open(path, std::ios::trunc);
+		if(!r.dump) {
+			s_EngineLogger->error("Failed to open metrics dump {}", path);
+			return;
+		}
+
+		r.dumpFormat = format;
+		r.dumpInterval = std::max(intervalFrames, 1u);
+		s_EngineLogger->info("Dumping metrics to {} every {} frames", path, r.dumpInterval);
+	}
+}
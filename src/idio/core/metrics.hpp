@@ -0,0 +1,78 @@
+/**
+ * Copyright (c) 2022 Connor Mellon
+ * 
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+#ifndef IDIO_CORE_METRICS_H
+#define IDIO_CORE_METRICS_H
+
+namespace idio
+{
+	using MetricId = uint32_t;
+	constexpr uint32_t s_MaxMetrics = 64;
+
+	enum class MetricKind
+	{
+		Counter, // Summed over a frame, then reset
+		Gauge    // Keeps the last value set
+	};
+
+	// Registered before anything else, so each one's id is its value
+	enum class EngineMetric : MetricId
+	{
+		DrawCalls,         // Draw commands recorded, an indirect draw counts once
+		PipelineBinds,
+		BufferUploadBytes, // Copied into mapped buffer memory by the cpu, each copy counted once
+		Submits,           // Queue submit calls
+		SwapchainRecreations,
+		FenceWaitMicros,   // Blocked on the frame fence in Context::begin_frame
+		HeapAllocations,   // Debug builds only
+		FrameTime,         // Gauge, see FrameStats
+		FrameLatency,      // Gauge, see FrameStats
+		Count
+	};
+
+	struct MetricSample
+	{
+		std::string_view name;
+		MetricKind kind;
+		double value;
+	};
+
+	struct MetricsSnapshot
+	{
+		uint64_t frame = 0;
+		std::vector<MetricSample> samples; // Indexed by MetricId
+
+		double get(MetricId id) const noexcept { return id < samples.size() ? samples[id].value : 0.0; }
+		double get(EngineMetric m) const noexcept { return get(static_cast<MetricId>(m)); }
+	};
+
+	enum class MetricsFormat
+	{
+		Csv, // A header row, then a row per dump
+		Json // One object per line
+	};
+
+	// Registering takes a lock and is meant for startup, registering a name twice returns the same id.
+	// Counting never locks, each thread adds into its own slots which collect_metrics sums up.
+	MetricId register_metric(std::string_view name, MetricKind kind);
+	void count_metric(MetricId id, uint64_t n = 1) noexcept;
+	void set_metric(MetricId id, double value) noexcept;
+	inline void count_metric(EngineMetric m, uint64_t n = 1) noexcept { count_metric(static_cast<MetricId>(m), n); }
+	inline void set_metric(EngineMetric m, double value) noexcept { set_metric(static_cast<MetricId>(m), value); }
+
+	// Closes a frame's counters, called by Context::end_frame
+	void collect_metrics(uint64_t frame);
+	// The last frame collected, only valid on the frame thread (the render thread when there is one)
+	// until the next collect. Other threads take a copy instead.
+	const MetricsSnapshot &get_metrics_snapshot();
+	MetricsSnapshot copy_metrics_snapshot();
+	// Appends every intervalFrames'th snapshot to path, an empty path stops dumping
+	void set_metrics_dump(const std::string &path, MetricsFormat format, uint32_t intervalFrames = 60);
+}
+
+#endif
@@ -0,0 +1,82 @@
+/**
+ * Copyright (c) 2022 Connor Mellon
+ * 
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+#include "pch.hpp"
+#include "packet.hpp"
+
+namespace idio
+{
+	FramePipe::FramePipe(uint32_t packetCount, size_t packetSize)
+	{
+		for(uint32_t i = 0; i < std::max(packetCount, 1u); i++) {
+			m_free.push_back(m_packets.emplace_back(std::make_unique<FramePacket>(packetSize)).get());
+		}
+	}
+
+	FramePacket &FramePipe::begin_build()
+	{
+		std::unique_lock lock(m_mutex);
+		m_cv.wait(lock, [this]() { return !m_free.empty(); });
+		FramePacket *p = m_free.back();
+		m_free.pop_back();
+		lock.unlock();
+
+		p->m_arena.reset();
+		p->m_root = nullptr;
+		p->m_sequence = m_sequence++;
+		return *p;
+	}
+
+	void FramePipe::end_build(FramePacket &p)
+	{
+		{
+			std::lock_guard lock(m_mutex);
+			m_ready.push_back(&p);
+		}
+		m_cv.notify_all();
+	}
+
+	FramePacket *FramePipe::begin_render()
+	{
+		std::unique_lock lock(m_mutex);
+		m_cv.wait(lock, [this]() { return m_closed || !m_ready.empty(); });
+		if(m_ready.empty()) {
+			return nullptr;
+		}
+
+		FramePacket *p = m_ready.front();
+		m_ready.pop_front();
+		m_rendering++;
+		return p;
+	}
+
+	void FramePipe::end_render(FramePacket &p)
+	{
+		{
+			std::lock_guard lock(m_mutex);
+			m_rendering--;
+			m_free.push_back(&p);
+		}
+		m_cv.notify_all();
+	}
+
+	void FramePipe::wait_idle()
+	{
+		std::unique_lock lock(m_mutex);
+		m_cv.wait(lock, [this]() { return m_ready.empty() && m_rendering == 0; });
+	}
+
+	void FramePipe::close()
+	{
+		{
+			std::lock_guard lock(m_mutex);
+			m_closed = true;
+		}
+		m_cv.notify_all();
+	}
+}
@@ -0,0 +1,94 @@
+/**
+ * Copyright (c) 2022 Connor Mellon
+ * 
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+#ifndef IDIO_CORE_PACKET_H
+#define IDIO_CORE_PACKET_H
+
+namespace idio
+{
+	// Everything needed to render one frame, built on the main thread and only read after that.
+	// Lives in its own arena, so the same trivially destructible data rules apply.
+	class FramePacket
+	{
+	public:
+		explicit FramePacket(size_t capacity) : m_arena(capacity) {}
+		FramePacket(const FramePacket &o) = delete;
+		FramePacket &operator=(const FramePacket &o) = delete;
+
+		template<typename T>
+		std::span<T> alloc(size_t count) { return m_arena.alloc<T>(count); }
+
+		template<typename T>
+		std::span<const T> copy(std::span<const T> src)
+		{
+			auto dst = m_arena.alloc<T>(src.size());
+			std::copy(src.begin(), src.end(), dst.begin());
+			return dst;
+		}
+
+		// One object the renderer starts from, get_root must ask for the same type
+		template<typename T>
+		T &set_root()
+		{
+			T &root = m_arena.alloc<T>(1)[0];
+			m_root = &root;
+			return root;
+		}
+
+		template<typename T>
+		const T &get_root() const { return *static_cast<const T *>(m_root); }
+		bool has_root() const noexcept { return m_root != nullptr; }
+
+		uint64_t get_sequence() const noexcept { return m_sequence; }
+		// How far the simulation had got past its last fixed step when this was built, for
+		// interpolating between the previous and current state. Always 1 without a fixed step.
+		float get_alpha() const noexcept { return m_alpha; }
+	private:
+		LinearArena m_arena;
+		void *m_root = nullptr;
+		uint64_t m_sequence = 0;
+		float m_alpha = 1.0f;
+
+		friend class FramePipe;
+		friend class Application;
+	};
+
+	// Bounded handoff of packets from the main thread to the render thread. With two packets
+	// one is being built while the other renders, and building blocks once both are taken.
+	class FramePipe
+	{
+	public:
+		FramePipe(uint32_t packetCount, size_t packetSize);
+		FramePipe(const FramePipe &o) = delete;
+		FramePipe &operator=(const FramePipe &o) = delete;
+
+		// Producer side, the packet comes back reset
+		FramePacket &begin_build();
+		void end_build(FramePacket &p);
+
+		// Consumer side, nullptr once closed and every built packet was rendered
+		FramePacket *begin_render();
+		void end_render(FramePacket &p);
+
+		// Blocks until every built packet has been rendered
+		void wait_idle();
+		void close();
+	private:
+		std::vector<std::unique_ptr<FramePacket>> m_packets;
+		std::vector<FramePacket *> m_free;
+		std::deque<FramePacket *> m_ready;
+		uint32_t m_rendering = 0;
+		uint64_t m_sequence = 0;
+		bool m_closed = false;
+
+		std::mutex m_mutex;
+		std::condition_variable m_cv;
+	};
+}
+
+#endif
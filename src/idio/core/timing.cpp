@@ -0,0 +1,51 @@
+/**
+ * Copyright (c) 2022 Connor Mellon
+ * 
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+#include "pch.hpp"
+#include "timing.hpp"
+
+namespace idio
+{
+	// Comfortably above the scheduler granularity on both platforms
+	constexpr auto k_YieldThreshold = std::chrono::microseconds(2000);
+
+	FrameLimiter::FrameLimiter(uint32_t maxFps) noexcept
+	{
+		set_max_fps(maxFps);
+	}
+
+	void FrameLimiter::set_max_fps(uint32_t maxFps) noexcept
+	{
+		m_maxFps = maxFps;
+		m_interval = maxFps == 0 ? Clock::duration::zero() :
+			std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(1.0 / maxFps));
+		m_next = Clock::now();
+	}
+
+	void FrameLimiter::wait() noexcept
+	{
+		if(m_maxFps == 0) {
+			return;
+		}
+
+		const auto deadline = m_next;
+		auto now = Clock::now();
+		if(deadline - now > k_YieldThreshold) {
+			std::this_thread::sleep_for(deadline - now - k_YieldThreshold);
+		}
+
+		while((now = Clock::now()) < deadline) {
+			std::this_thread::yield();
+		}
+
+		m_next = deadline + m_interval;
+		if(m_next < now) {
+			m_next = now + m_interval;
+		}
+	}
+}
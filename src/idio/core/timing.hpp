@@ -0,0 +1,36 @@
+/**
+ * Copyright (c) 2022 Connor Mellon
+ * 
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+#ifndef IDIO_CORE_TIMING_H
+#define IDIO_CORE_TIMING_H
+
+namespace idio
+{
+	using Clock = std::chrono::steady_clock;
+
+	// Caps the frame rate by sleeping the cpu, used when present wait isn't available or can't express the cap.
+	// Os sleeps overshoot, so the last stretch before each deadline is spent yielding instead.
+	class FrameLimiter
+	{
+	public:
+		explicit FrameLimiter(uint32_t maxFps = 0) noexcept;
+
+		void set_max_fps(uint32_t maxFps) noexcept; // 0 is uncapped
+		uint32_t get_max_fps() const noexcept { return m_maxFps; }
+
+		// Blocks until a frame interval has passed since the last deadline. A late frame
+		// moves the deadline instead of letting the next few frames run uncapped to catch up.
+		void wait() noexcept;
+	private:
+		uint32_t m_maxFps = 0;
+		Clock::duration m_interval {};
+		Clock::time_point m_next {};
+	};
+}
+
+#endif
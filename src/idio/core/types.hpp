@@ -25,6 +25,8 @@ namespace idio
 	};
 
 	constexpr Version k_EngineVersion { 0, 0, 1 };
+	// Throughput over latency, 1-2 suits fast machines that can keep the gpu fed anyway
+	constexpr uint32_t s_DefaultFramesInFlight = 3;
 
 	using Logger = std::shared_ptr<spdlog::logger>;
 	extern Logger s_EngineLogger;
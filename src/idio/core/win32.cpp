@@ -6,6 +6,9 @@
  * file, You can obtain one at http://mozilla.org/MPL/2.0/.
  */
 
+#include "pch.hpp"
+#include "file.hpp"
+
 extern void idio_main(int argc, char **argv);
 
 #define WIN32_LEAN_AND_MEAN
@@ -14,6 +17,46 @@ extern void idio_main(int argc, char **argv);
 #define _CRTDBG_MAP_ALLOC
 #include <crtdbg.h>
 
+namespace idio
+{
+	MappedFile::MappedFile(const std::string &pth)
+	{
+		HANDLE file = CreateFileA(pth.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+			FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+		if(file == INVALID_HANDLE_VALUE) {
+			s_EngineLogger->warn("Failed to open {}", pth);
+			return;
+		}
+
+		LARGE_INTEGER sz {};
+		if(GetFileSizeEx(file, &sz) && sz.QuadPart > 0) {
+			HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+			if(mapping) {
+				m_data = static_cast<const std::byte *>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+				if(m_data) {
+					m_size = static_cast<size_t>(sz.QuadPart);
+				}
+
+				// The view keeps the mapping and file alive
+				CloseHandle(mapping);
+			}
+
+			if(!m_data) {
+				s_EngineLogger->warn("Failed to map {}", pth);
+			}
+		}
+
+		CloseHandle(file);
+	}
+
+	MappedFile::~MappedFile()
+	{
+		if(m_data) {
+			UnmapViewOfFile(m_data);
+		}
+	}
+}
+
 void reopen_console()
 {
 	AllocConsole();
@@ -8,13 +8,15 @@
 
 #include "pch.hpp"
 #include "window.hpp"
+#include "gfx/device.hpp"
 #include "gfx/context.hpp"
 #include "gfx/swapchain.hpp"
 
 namespace idio
 {
 	Window::Window(const WindowCreateInfo &wci) :
-		m_vsync(wci.vsync)
+		m_presentPolicy(wci.presentPolicy),
+		m_maxFps(wci.maxFps)
 	{
 		uint32_t winflags = SDL_WINDOW_VULKAN;
 		if(wci.borderless) {
@@ -67,6 +69,22 @@ namespace idio
 		m_fullscrState = s;
 	}
 
+	void Window::set_present_policy(PresentPolicy p, uint32_t maxFps)
+	{
+		m_presentPolicy = p;
+		m_maxFps = maxFps;
+	}
+
+	uint32_t Window::get_refresh_rate() const
+	{
+		SDL_DisplayMode mode {};
+		if(SDL_GetWindowDisplayMode(m_handle, &mode) != 0 || mode.refresh_rate <= 0) {
+			return 0;
+		}
+
+		return static_cast<uint32_t>(mode.refresh_rate);
+	}
+
 	void Window::create_swapchain(const Context &c)
 	{
 		if(m_swapchain == nullptr) {
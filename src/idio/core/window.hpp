@@ -24,9 +24,20 @@ namespace idio
 		Exclusive
 	};
 
+	// Trades input latency against tearing and power use, picks the present mode and swapchain image count.
+	// Modes the surface doesn't support fall back towards Vsync, which is always available.
+	enum class PresentPolicy
+	{
+		Vsync,      // FIFO, never tears, at most two frames queued for the display
+		LowLatency, // MAILBOX, each frame starts once the last one reached the display (or at the refresh rate)
+		Uncapped,   // IMMEDIATE, may tear, for benchmarking
+		Capped      // MAILBOX with the cpu limited to maxFps, saves power on fast machines
+	};
+
 	struct WindowCreateInfo
 	{
-		bool vsync = false;
+		PresentPolicy presentPolicy = PresentPolicy::Vsync;
+		uint32_t maxFps = 0; // Only used with PresentPolicy::Capped
 		bool borderless = false;
 		bool resizeable = false;
 		int32_t width = 1280;
@@ -50,16 +61,27 @@ namespace idio
 		void create_swapchain(const Context &c);
 
 		bool clear();
+		bool is_minimised() const { return m_minimised; }
+		void set_minimised(bool m) { m_minimised = m; }
+		bool has_focus() const { return m_focused; }
+		void set_focus(bool f) { m_focused = f; }
 
 		uint32_t get_id() const { return m_id; }
-		bool is_vsync() const { return m_vsync; }
+		PresentPolicy get_present_policy() const { return m_presentPolicy; }
+		uint32_t get_max_fps() const { return m_maxFps; }
+		uint32_t get_refresh_rate() const; // 0 when the display doesn't say
+		// Applied the next time the swapchain is created
+		void set_present_policy(PresentPolicy p, uint32_t maxFps = 0);
 		Swapchain &get_swapchain() const { return *m_swapchain; }
 
 		bool operator==(const Window &o) const { return m_id == o.m_id; }
 		operator SDL_Window *() const { return m_handle; }
 	private:
 		uint32_t m_id = 0;
-		bool m_vsync = false;
+		PresentPolicy m_presentPolicy = PresentPolicy::Vsync;
+		uint32_t m_maxFps = 0;
+		bool m_minimised = false;
+		bool m_focused = true;
 		SDL_Window *m_handle = nullptr;
 		Swapchain *m_swapchain = nullptr;
 		FullscreenState m_fullscrState = FullscreenState::Normal;
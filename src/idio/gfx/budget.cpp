@@ -0,0 +1,75 @@
+/**
+ * Copyright (c) 2022 Connor Mellon
+ * 
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+#include "pch.hpp"
+#include "budget.hpp"
+
+#include "device.hpp"
+#include "context.hpp"
+
+namespace idio
+{
+	vk::DeviceSize MemoryStats::get_unused_bytes() const noexcept
+	{
+		vk::DeviceSize unused = 0;
+		for(uint32_t i = 0; i < heapCount; i++) {
+			unused += heaps[i].blockBytes - heaps[i].allocationBytes;
+		}
+
+		return unused;
+	}
+
+	bool MemoryStats::is_over_budget(float fraction) const noexcept
+	{
+		for(uint32_t i = 0; i < heapCount; i++) {
+			const auto limit = static_cast<double>(heaps[i].budget) * static_cast<double>(fraction);
+			if(heaps[i].budget != 0 && static_cast<double>(heaps[i].usage) > limit) {
+				return true;
+			}
+		}
+
+		return false;
+	}
+
+	MemoryStats query_memory_stats(const Context &c)
+	{
+		const VkPhysicalDeviceMemoryProperties *props = nullptr;
+		vmaGetMemoryProperties(c.get_allocator(), &props);
+
+		std::array<VmaBudget, VK_MAX_MEMORY_HEAPS> budgets {};
+		vmaGetHeapBudgets(c.get_allocator(), budgets.data());
+
+		MemoryStats stats {};
+		stats.heapCount = props->memoryHeapCount;
+		for(uint32_t i = 0; i < stats.heapCount; i++) {
+			auto &h = stats.heaps[i];
+			h.deviceLocal = (props->memoryHeaps[i].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT) != 0;
+			h.usage = budgets[i].usage;
+			h.budget = budgets[i].budget;
+			h.blockBytes = budgets[i].statistics.blockBytes;
+			h.allocationBytes = budgets[i].statistics.allocationBytes;
+			h.blockCount = budgets[i].statistics.blockCount;
+			h.allocationCount = budgets[i].statistics.allocationCount;
+		}
+
+		return stats;
+	}
+
+	void log_memory_stats(const MemoryStats &stats)
+	{
+		constexpr double mib = 1024.0 * 1024.0;
+		for(uint32_t i = 0; i < stats.heapCount; i++) {
+			const auto &h = stats.heaps[i];
+			s_EngineLogger->info("Heap {}{}: {:.1f}/{:.1f} MiB, {} allocations in {} blocks ({:.1f} MiB unused)",
+				i, h.deviceLocal ? " (device)" : "",
+				static_cast<double>(h.usage) / mib, static_cast<double>(h.budget) / mib,
+				h.allocationCount, h.blockCount,
+				static_cast<double>(h.blockBytes - h.allocationBytes) / mib);
+		}
+	}
+}
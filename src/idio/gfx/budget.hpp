@@ -0,0 +1,41 @@
+/**
+ * Copyright (c) 2022 Connor Mellon
+ * 
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+#ifndef IDIO_GFX_BUDGET_H
+#define IDIO_GFX_BUDGET_H
+
+namespace idio
+{
+	class Context;
+
+	struct HeapStats
+	{
+		bool deviceLocal = false;
+		vk::DeviceSize usage = 0;  // Whole process, as reported by VK_EXT_memory_budget when available
+		vk::DeviceSize budget = 0;
+		vk::DeviceSize blockBytes = 0;
+		vk::DeviceSize allocationBytes = 0;
+		uint32_t blockCount = 0;
+		uint32_t allocationCount = 0;
+	};
+
+	struct MemoryStats
+	{
+		uint32_t heapCount = 0;
+		std::array<HeapStats, VK_MAX_MEMORY_HEAPS> heaps;
+
+		// Bytes inside VMA blocks that no allocation is using
+		vk::DeviceSize get_unused_bytes() const noexcept;
+		bool is_over_budget(float fraction = 0.95f) const noexcept;
+	};
+
+	MemoryStats query_memory_stats(const Context &c);
+	void log_memory_stats(const MemoryStats &stats);
+}
+
+#endif
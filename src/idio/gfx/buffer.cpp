@@ -10,30 +10,55 @@
 #include "buffer.hpp"
 
 #include "vkutl.hpp"
+#include "device.hpp"
 #include "context.hpp"
 
 namespace idio
 {
 	template<BufferType T, BufferUse Use>
-	Buffer<T, Use>::Buffer(const Context &c, vk::DeviceSize sz) :
-		m_context(c), m_size(sz)
+	Buffer<T, Use>::Buffer(const Context &c, vk::DeviceSize sz, vk::IndexType indexType) :
+		m_context(c), m_size(sz), m_indexType(indexType)
 	{
 		vk::BufferCreateInfo bci {};
 		bci.size = sz;
-		bci.sharingMode = vk::SharingMode::eExclusive; // We don't support transfer queues yet
-		bci.usage = static_cast<vk::BufferUsageFlagBits>(T);
+		if constexpr(Use == BufferUse::Dynamic) {
+			// Regions are flushed individually so keep them apart by the non coherent atom size
+			const auto atom = std::max<vk::DeviceSize>(c.get_physdev().props.limits.nonCoherentAtomSize, 1);
+			m_regionStride = (sz + atom - 1) / atom * atom;
+			bci.size = m_regionStride * c.get_max_frames_in_flight();
+		}
+		bci.sharingMode = vk::SharingMode::eExclusive;
+		bci.usage = vk::BufferUsageFlags(static_cast<VkBufferUsageFlags>(T));
 		if constexpr(Use == BufferUse::Staging) {
 			bci.usage |= vk::BufferUsageFlagBits::eTransferSrc;
 		} else {
 			bci.usage |= vk::BufferUsageFlagBits::eTransferDst;
 		}
 
+		// Storage buffers are shared with the async compute queue without ownership transfers,
+		// concurrent sharing can be slower so nothing else opts in
+		constexpr bool storage = (static_cast<VkBufferUsageFlags>(T) & VK_BUFFER_USAGE_STORAGE_BUFFER_BIT) != 0;
+		const uint32_t families[] = { c.get_queue_family(QueueType::Graphics), c.get_queue_family(QueueType::Compute) };
+		if constexpr(storage && Use != BufferUse::Staging) {
+			if(c.has_async_compute()) {
+				bci.sharingMode = vk::SharingMode::eConcurrent;
+				bci.queueFamilyIndexCount = 2;
+				bci.pQueueFamilyIndices = families;
+			}
+		}
+
 		VmaAllocationCreateInfo aci {};
 		aci.flags = VMA_ALLOCATION_CREATE_MAPPED_BIT;
 		if constexpr(T == BufferType::Uniform) {
 			aci.usage = VMA_MEMORY_USAGE_CPU_TO_GPU;
 		} else if constexpr(Use == BufferUse::Staging) {
 			aci.usage = VMA_MEMORY_USAGE_CPU_ONLY;
+		} else if constexpr(Use == BufferUse::Dynamic) {
+			aci.usage = VMA_MEMORY_USAGE_CPU_TO_GPU;
+		} else if constexpr(Use == BufferUse::Direct) {
+			aci.usage = VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE;
+			aci.flags |= VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT
+				| VMA_ALLOCATION_CREATE_HOST_ACCESS_ALLOW_TRANSFER_INSTEAD_BIT;
 		} else {
 			aci.usage = VMA_MEMORY_USAGE_GPU_ONLY;
 		}
@@ -42,8 +67,17 @@ namespace idio
 		auto rawbci = static_cast<VkBufferCreateInfo>(bci);
 		check_vk(vmaCreateBuffer(c.get_allocator(), &rawbci, &aci, &tmpbuf, &m_alloc, &m_allocInfo), "Failed to create buffer");
 		m_buffer = static_cast<vk::Buffer>(tmpbuf);
-		if constexpr(Use == BufferUse::Staging) {
+		if constexpr(Use == BufferUse::Staging || Use == BufferUse::Dynamic || T == BufferType::Uniform) {
 			m_mappedData = m_allocInfo.pMappedData;
+		} else if constexpr(Use == BufferUse::Direct) {
+			VkMemoryPropertyFlags memflags = 0;
+			vmaGetAllocationMemoryProperties(c.get_allocator(), m_alloc, &memflags);
+			if(memflags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) {
+				m_mappedData = m_allocInfo.pMappedData;
+			} else {
+				m_staging = std::make_unique<Buffer<T, BufferUse::Staging>>(c, sz * c.get_max_frames_in_flight());
+				m_shadow.resize(sz);
+			}
 		}
 	}
 
@@ -63,20 +97,243 @@ namespace idio
 		cmd.copyBuffer(o, m_buffer, cbi);
 	}
 
-	template<>
-	void VertexBuffer<BufferUse::Gpu>::bind(vk::CommandBuffer cmd, const std::vector<std::shared_ptr<VertexBuffer<BufferUse::Gpu>>> &bfrs,
-		const std::vector<vk::DeviceSize> &offsets)
+	template<BufferType T, BufferUse Use>
+	void Buffer<T, Use>::flush_cmd(vk::CommandBuffer cmd)
+	{
+		if(m_dirtyBegin >= m_dirtyEnd) {
+			return;
+		}
+
+		const size_t sz = m_dirtyEnd - m_dirtyBegin;
+		if(m_staging) {
+			// This frame's region was last read by the copy recorded the previous time its fence came round
+			const size_t region = m_size * m_context.get_frame_index();
+			m_staging->write(m_shadow.data() + m_dirtyBegin, sz, region + m_dirtyBegin);
+
+			// Earlier frames may still be reading the old contents
+			cmd.pipelineBarrier(vk::PipelineStageFlagBits::eAllCommands, vk::PipelineStageFlagBits::eTransfer,
+				{}, nullptr, nullptr, nullptr);
+			copy_from(cmd, *m_staging, sz, region + m_dirtyBegin, m_dirtyBegin);
+
+			vk::MemoryBarrier mb {};
+			mb.srcAccessMask = vk::AccessFlagBits::eTransferWrite;
+			mb.dstAccessMask = vk::AccessFlagBits::eMemoryRead;
+			cmd.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eAllCommands,
+				{}, mb, nullptr, nullptr);
+		} else {
+			check_vk(vmaFlushAllocation(m_context.get_allocator(), m_alloc, m_dirtyBegin, sz), "Failed to flush buffer");
+		}
+
+		m_dirtyBegin = std::numeric_limits<size_t>::max();
+		m_dirtyEnd = 0;
+	}
+
+	template<BufferType T, BufferUse Use>
+	void Buffer<T, Use>::write_direct(const void *data, size_t sz, size_t offset)
+	{
+		if(offset + sz > m_size) {
+			s_EngineLogger->critical("Direct buffer write out of range ({} > {})", offset + sz, m_size);
+			Application::crash();
+		}
+
+		if(m_staging) {
+			std::memcpy(m_shadow.data() + offset, data, sz);
+		} else {
+			std::memcpy(static_cast<uint8_t *>(m_mappedData) + offset, data, sz);
+			count_metric(EngineMetric::BufferUploadBytes, sz);
+		}
+
+		m_dirtyBegin = std::min(m_dirtyBegin, offset);
+		m_dirtyEnd = std::max(m_dirtyEnd, offset + sz);
+	}
+
+	template<BufferType T, BufferUse Use>
+	vk::DeviceSize Buffer<T, Use>::get_frame_offset() const
+	{
+		return m_regionStride * m_context.get_frame_index();
+	}
+
+	template<BufferType T, BufferUse Use>
+	void Buffer<T, Use>::write_dynamic(const void *data, size_t sz, size_t offset)
+	{
+		if(offset + sz > m_size) {
+			s_EngineLogger->critical("Dynamic buffer write out of range ({} > {})", offset + sz, m_size);
+			Application::crash();
+		}
+
+		// The gpu may still be reading the other regions, this frame's one is free since its fence was waited on
+		const auto frameOffset = get_frame_offset();
+		std::memcpy(static_cast<uint8_t *>(m_mappedData) + frameOffset + offset, data, sz);
+		count_metric(EngineMetric::BufferUploadBytes, sz);
+		check_vk(vmaFlushAllocation(m_context.get_allocator(), m_alloc, frameOffset + offset, sz), "Failed to flush buffer");
+	}
+
+	template<BufferType T, BufferUse Use>
+	void Buffer<T, Use>::bind(vk::CommandBuffer cmd, std::span<const std::shared_ptr<Buffer<T, Use>>> bfrs,
+		std::span<const vk::DeviceSize> offsets)
+	{
+		if constexpr(T == BufferType::Vertex) {
+			constexpr size_t maxBindings = 16;
+			if(bfrs.size() > maxBindings) {
+				s_EngineLogger->critical("Too many vertex bindings ({})", bfrs.size());
+				Application::crash();
+			}
+
+			std::array<vk::Buffer, maxBindings> hdls;
+			std::transform(bfrs.begin(), bfrs.end(), hdls.begin(), [](const std::shared_ptr<Buffer<T, Use>> &v) { return v->m_buffer; });
+			if constexpr(Use == BufferUse::Dynamic) {
+				std::array<vk::DeviceSize, maxBindings> offs;
+				for(size_t i = 0; i < bfrs.size(); i++) {
+					offs[i] = offsets[i] + bfrs[i]->get_frame_offset();
+				}
+				cmd.bindVertexBuffers(0, static_cast<uint32_t>(bfrs.size()), hdls.data(), offs.data());
+			} else {
+				cmd.bindVertexBuffers(0, static_cast<uint32_t>(bfrs.size()), hdls.data(), offsets.data());
+			}
+		} else if constexpr(T == BufferType::Index) {
+			vk::DeviceSize offset = offsets[0];
+			if constexpr(Use == BufferUse::Dynamic) {
+				offset += bfrs[0]->get_frame_offset();
+			}
+			cmd.bindIndexBuffer(bfrs[0]->m_buffer, offset, bfrs[0]->m_indexType);
+		} else {
+			s_EngineLogger->warn("Only vertex and index buffers can be bound");
+		}
+	}
+
+	IndirectBatch::IndirectBatch(const Context &c, uint32_t maxDraws) :
+		m_context(c), m_maxDraws(maxDraws), m_draws(maxDraws)
 	{
-		std::vector<vk::Buffer> hdls(bfrs.size());
-		std::transform(bfrs.begin(), bfrs.end(), hdls.begin(), [](std::shared_ptr<VertexBuffer<BufferUse::Gpu>> v) { return v->m_buffer; });
-		cmd.bindVertexBuffers(0, hdls, offsets);
+		constexpr auto stride = sizeof(vk::DrawIndexedIndirectCommand);
+		m_staging = std::make_unique<IndirectBuffer<BufferUse::Staging>>(c, stride * maxDraws * c.get_max_frames_in_flight());
+		m_gpu = std::make_unique<IndirectBuffer<BufferUse::Gpu>>(c, stride * maxDraws);
 	}
 
-	template<>
-	void IndexBuffer<BufferUse::Gpu>::bind(vk::CommandBuffer cmd, const std::vector<std::shared_ptr<IndexBuffer<BufferUse::Gpu>>> &bfrs,
-		const std::vector<vk::DeviceSize> &offsets)
+	void IndirectBatch::add(const vk::DrawIndexedIndirectCommand &dc)
 	{
-		cmd.bindIndexBuffer(bfrs[0]->m_buffer, offsets[0], vk::IndexType::eUint32);
+		if(m_count == m_maxDraws) {
+			s_EngineLogger->warn("Indirect batch full, dropping draw");
+			return;
+		}
+
+		m_draws[m_count++] = dc;
+	}
+
+	void IndirectBatch::upload_cmd(vk::CommandBuffer cmd, uint32_t frameIndex)
+	{
+		if(m_count == 0) {
+			return;
+		}
+
+		constexpr auto stride = sizeof(vk::DrawIndexedIndirectCommand);
+		const size_t sz = stride * m_count;
+		const size_t srcOffset = stride * m_maxDraws * frameIndex;
+		m_staging->write(m_draws.data(), sz, srcOffset);
+
+		// Previous frames may still be reading the gpu side
+		cmd.pipelineBarrier(vk::PipelineStageFlagBits::eDrawIndirect, vk::PipelineStageFlagBits::eTransfer,
+			{}, nullptr, nullptr, nullptr);
+		m_gpu->copy_from(cmd, *m_staging, sz, srcOffset, 0);
+
+		vk::MemoryBarrier mb {};
+		mb.srcAccessMask = vk::AccessFlagBits::eTransferWrite;
+		mb.dstAccessMask = vk::AccessFlagBits::eIndirectCommandRead;
+		cmd.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eDrawIndirect,
+			{}, mb, nullptr, nullptr);
+	}
+
+	void IndirectBatch::draw_cmd(vk::CommandBuffer cmd) const
+	{
+		m_context.draw_indexed_indirect_cmd(cmd, *m_gpu, 0, m_count);
+	}
+
+	UniformRing::UniformRing(const Context &c, vk::DeviceSize frameSize, vk::DeviceSize maxSliceSize) :
+		m_context(c), m_maxSliceSize(maxSliceSize)
+	{
+		m_alignment = std::max<vk::DeviceSize>(c.get_physdev().props.limits.minUniformBufferOffsetAlignment, 1);
+		m_frameSize = (frameSize + m_alignment - 1) & ~(m_alignment - 1);
+
+		vk::BufferCreateInfo bci {};
+		bci.size = m_frameSize * c.get_max_frames_in_flight() + m_maxSliceSize; // Last slice's descriptor range must stay in bounds
+		bci.sharingMode = vk::SharingMode::eExclusive;
+		bci.usage = vk::BufferUsageFlagBits::eUniformBuffer;
+
+		VmaAllocationCreateInfo aci {};
+		aci.flags = VMA_ALLOCATION_CREATE_MAPPED_BIT;
+		aci.usage = VMA_MEMORY_USAGE_CPU_TO_GPU;
+		aci.requiredFlags = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+
+		VkBuffer tmpbuf;
+		VmaAllocationInfo ai {};
+		auto rawbci = static_cast<VkBufferCreateInfo>(bci);
+		check_vk(vmaCreateBuffer(c.get_allocator(), &rawbci, &aci, &tmpbuf, &m_alloc, &ai), "Failed to create uniform ring");
+		m_buffer = static_cast<vk::Buffer>(tmpbuf);
+		m_mappedData = static_cast<uint8_t *>(ai.pMappedData);
+
+		vk::DescriptorSetLayoutBinding binding {};
+		binding.binding = 0;
+		binding.descriptorCount = 1;
+		binding.descriptorType = vk::DescriptorType::eUniformBufferDynamic;
+		binding.stageFlags = vk::ShaderStageFlagBits::eAllGraphics | vk::ShaderStageFlagBits::eCompute;
+
+		vk::DescriptorSetLayoutCreateInfo lci {};
+		lci.bindingCount = 1;
+		lci.pBindings = &binding;
+		m_layout = check_vk(c.get_device().createDescriptorSetLayout(lci), "Failed to create uniform ring layout");
+
+		vk::DescriptorPoolSize psz { vk::DescriptorType::eUniformBufferDynamic, 1 };
+		vk::DescriptorPoolCreateInfo pci {};
+		pci.maxSets = 1;
+		pci.poolSizeCount = 1;
+		pci.pPoolSizes = &psz;
+		m_pool = check_vk(c.get_device().createDescriptorPool(pci), "Failed to create uniform ring pool");
+
+		vk::DescriptorSetAllocateInfo dai {};
+		dai.descriptorPool = m_pool;
+		dai.descriptorSetCount = 1;
+		dai.pSetLayouts = &m_layout;
+		m_set = check_vk(c.get_device().allocateDescriptorSets(dai), "Failed to allocate uniform ring set")[0];
+
+		vk::DescriptorBufferInfo dbi {};
+		dbi.buffer = m_buffer;
+		dbi.offset = 0;
+		dbi.range = m_maxSliceSize;
+
+		vk::WriteDescriptorSet wds {};
+		wds.dstSet = m_set;
+		wds.dstBinding = 0;
+		wds.descriptorCount = 1;
+		wds.descriptorType = vk::DescriptorType::eUniformBufferDynamic;
+		wds.pBufferInfo = &dbi;
+		c.get_device().updateDescriptorSets(wds, nullptr);
+	}
+
+	UniformRing::~UniformRing()
+	{
+		m_context.get_device().destroyDescriptorPool(m_pool);
+		m_context.get_device().destroyDescriptorSetLayout(m_layout);
+		vmaDestroyBuffer(m_context.get_allocator(), m_buffer, m_alloc);
+	}
+
+	void UniformRing::begin_frame(uint32_t frameIndex)
+	{
+		m_frameBase = m_frameSize * frameIndex;
+		m_head = 0;
+	}
+
+	UniformSlice UniformRing::allocate(vk::DeviceSize sz)
+	{
+		if(sz > m_maxSliceSize || m_head + sz > m_frameSize) {
+			s_EngineLogger->critical("Uniform ring exhausted ({} of {} bytes used, {} requested)", m_head, m_frameSize, sz);
+			Application::crash();
+		}
+
+		UniformSlice slice {};
+		slice.size = sz;
+		slice.data = m_mappedData + m_frameBase + m_head;
+		slice.offset = static_cast<uint32_t>(m_frameBase + m_head);
+		m_head += (sz + m_alignment - 1) & ~(m_alignment - 1);
+		return slice;
 	}
 
 	template class Buffer<BufferType::Vertex, BufferUse::Gpu>;
@@ -84,4 +341,16 @@ namespace idio
 	template class Buffer<BufferType::Index, BufferUse::Gpu>;
 	template class Buffer<BufferType::Index, BufferUse::Staging>;
 	template class Buffer<BufferType::Uniform, BufferUse::Gpu>;
+	template class Buffer<BufferType::Indirect, BufferUse::Gpu>;
+	template class Buffer<BufferType::Indirect, BufferUse::Staging>;
+	template class Buffer<BufferType::Storage, BufferUse::Gpu>;
+	template class Buffer<BufferType::Storage, BufferUse::Staging>;
+	template class Buffer<BufferType::IndirectStorage, BufferUse::Gpu>;
+	template class Buffer<BufferType::Transfer, BufferUse::Staging>;
+	template class Buffer<BufferType::Vertex, BufferUse::Direct>;
+	template class Buffer<BufferType::Index, BufferUse::Direct>;
+	template class Buffer<BufferType::Storage, BufferUse::Direct>;
+	template class Buffer<BufferType::Indirect, BufferUse::Direct>;
+	template class Buffer<BufferType::Vertex, BufferUse::Dynamic>;
+	template class Buffer<BufferType::Index, BufferUse::Dynamic>;
 }
\ No newline at end of file
@@ -17,49 +17,88 @@ namespace idio
 	{
 		Vertex = VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
 		Index = VK_BUFFER_USAGE_INDEX_BUFFER_BIT,
-		Uniform = VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT
+		Uniform = VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
+		Indirect = VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT,
+		// Only types with the storage bit can be bound to compute, and only those are shared with the async compute queue
+		Storage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+		IndirectStorage = VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, // Draws written by compute
+		Transfer = VK_BUFFER_USAGE_TRANSFER_SRC_BIT // Source for image uploads
 	};
 
 	enum class BufferUse
 	{
 		Staging,
-		Gpu
+		Gpu,
+		// Device local, written in place when host visible (ReBAR/UMA) and staged otherwise.
+		// In place writes land immediately, so they must not touch ranges frames in flight still read,
+		// use Dynamic for data that changes every frame.
+		Direct,
+		Dynamic // Host visible, one region per frame in flight; rewritten every frame without stalling
 	};
 
 	template<BufferType T, BufferUse Use>
 	class Buffer
 	{
 	public:
-		Buffer(const Context &c, vk::DeviceSize sz);
+		// indexType is only used by index buffers
+		Buffer(const Context &c, vk::DeviceSize sz, vk::IndexType indexType = vk::IndexType::eUint32);
 		~Buffer();
 		Buffer(const Buffer &o) = delete;
 		Buffer &operator=(const Buffer &o) = delete;
 
 		void write(auto *data, size_t sz, size_t offset)
 		{
-			if constexpr(Use == BufferUse::Staging) {
+			if constexpr(Use == BufferUse::Staging || T == BufferType::Uniform) {
+				// Every staged upload (meshes, textures, streamed files, Direct fallbacks) passes through here
 				uint8_t *dst = static_cast<uint8_t *>(m_mappedData) + offset;
 				std::memcpy(dst, data, sz);
+				count_metric(EngineMetric::BufferUploadBytes, sz);
+			} else if constexpr(Use == BufferUse::Direct) {
+				write_direct(data, sz, offset);
+			} else if constexpr(Use == BufferUse::Dynamic) {
+				write_dynamic(data, sz, offset);
 			} else {
 				s_EngineLogger->warn("Cannot write to gpu side buffer");
 			}
 		}
 
 		void copy_from(vk::CommandBuffer cmd, Buffer<T, BufferUse::Staging> &o, size_t sz, size_t srcOffset, size_t dstOffset);
+		// Direct buffers only: makes written data visible to the gpu, recording a staging copy when needed.
+		// The staging copy reads this frame's staging region, so it is safe to record every frame.
+		void flush_cmd(vk::CommandBuffer cmd);
 
+		bool is_host_visible() const { return m_mappedData != nullptr; }
+		vk::IndexType get_index_type() const { return m_indexType; }
+		// Dynamic buffers only: start of the current frame's region
+		vk::DeviceSize get_frame_offset() const;
 		operator vk::Buffer() const { return m_buffer; }
 
-		static void bind(vk::CommandBuffer cmd, const std::vector<std::shared_ptr<Buffer<T, Use>>> &bfrs,
-			const std::vector<vk::DeviceSize> &offsets);
+		static void bind(vk::CommandBuffer cmd, std::span<const std::shared_ptr<Buffer<T, Use>>> bfrs,
+			std::span<const vk::DeviceSize> offsets);
 	private:
 		const Context &m_context;
 		vk::DeviceSize m_size;
 		vk::DeviceSize m_allocated = 0;
+		vk::IndexType m_indexType;
 
 		void *m_mappedData = nullptr;
 		vk::Buffer m_buffer;
 		VmaAllocation m_alloc;
 		VmaAllocationInfo m_allocInfo;
+
+		// Direct buffers that didn't get host visible memory. Writes collect in m_shadow and are copied
+		// into a staging region per frame in flight on flush, as earlier frames' copies may not have run yet.
+		std::unique_ptr<Buffer<T, BufferUse::Staging>> m_staging;
+		std::vector<uint8_t> m_shadow;
+		size_t m_dirtyBegin = std::numeric_limits<size_t>::max();
+		size_t m_dirtyEnd = 0;
+
+		void write_direct(const void *data, size_t sz, size_t offset);
+
+		// Distance between per-frame regions of dynamic buffers
+		vk::DeviceSize m_regionStride = 0;
+
+		void write_dynamic(const void *data, size_t sz, size_t offset);
 	};
 
 	template<BufferUse Use>
@@ -67,6 +106,87 @@ namespace idio
 	template<BufferUse Use>
 	using IndexBuffer = Buffer<BufferType::Index, Use>;
 	using UniformBuffer = Buffer<BufferType::Uniform, BufferUse::Gpu>;
+	template<BufferUse Use>
+	using IndirectBuffer = Buffer<BufferType::Indirect, Use>;
+	template<BufferUse Use>
+	using StorageBuffer = Buffer<BufferType::Storage, Use>;
+	using IndirectStorageBuffer = Buffer<BufferType::IndirectStorage, BufferUse::Gpu>;
+	using TransferBuffer = Buffer<BufferType::Transfer, BufferUse::Staging>;
+	using DynamicVertexBuffer = Buffer<BufferType::Vertex, BufferUse::Dynamic>;
+	using DynamicIndexBuffer = Buffer<BufferType::Index, BufferUse::Dynamic>;
+
+	// Gathers indexed draws on the cpu and issues them with one indirect call.
+	// Staging is split per frame in flight; the gpu copy is shared and guarded by barriers.
+	class IndirectBatch
+	{
+	public:
+		IndirectBatch(const Context &c, uint32_t maxDraws);
+
+		void clear() { m_count = 0; }
+		void add(const vk::DrawIndexedIndirectCommand &dc);
+		void upload_cmd(vk::CommandBuffer cmd, uint32_t frameIndex);
+		void draw_cmd(vk::CommandBuffer cmd) const;
+
+		uint32_t size() const { return m_count; }
+	private:
+		const Context &m_context;
+		uint32_t m_maxDraws;
+		uint32_t m_count = 0;
+
+		std::vector<vk::DrawIndexedIndirectCommand> m_draws;
+		std::unique_ptr<IndirectBuffer<BufferUse::Staging>> m_staging;
+		std::unique_ptr<IndirectBuffer<BufferUse::Gpu>> m_gpu;
+	};
+
+	struct UniformSlice
+	{
+		void *data = nullptr;
+		uint32_t offset = 0; // Dynamic offset to bind the slice with
+		vk::DeviceSize size = 0;
+	};
+
+	// Persistently mapped uniform memory, one region per frame in flight.
+	// Slices are handed out with a bump pointer and bound through a single
+	// dynamic uniform descriptor, so per-draw data never needs its own buffer.
+	class UniformRing
+	{
+	public:
+		UniformRing(const Context &c, vk::DeviceSize frameSize, vk::DeviceSize maxSliceSize = 256);
+		~UniformRing();
+		UniformRing(const UniformRing &o) = delete;
+		UniformRing &operator=(const UniformRing &o) = delete;
+
+		void begin_frame(uint32_t frameIndex);
+		UniformSlice allocate(vk::DeviceSize sz);
+
+		template<typename U>
+		UniformSlice push(const U &data)
+		{
+			auto slice = allocate(sizeof(U));
+			std::memcpy(slice.data, &data, sizeof(U));
+			count_metric(EngineMetric::BufferUploadBytes, sizeof(U));
+			return slice;
+		}
+
+		vk::DescriptorSet get_set() const { return m_set; }
+		vk::DescriptorSetLayout get_layout() const { return m_layout; }
+		operator vk::Buffer() const { return m_buffer; }
+	private:
+		const Context &m_context;
+		vk::DeviceSize m_frameSize;
+		vk::DeviceSize m_maxSliceSize;
+		vk::DeviceSize m_alignment;
+		vk::DeviceSize m_frameBase = 0;
+		vk::DeviceSize m_head = 0;
+
+		uint8_t *m_mappedData = nullptr;
+		vk::Buffer m_buffer;
+		VmaAllocation m_alloc;
+
+		vk::DescriptorPool m_pool;
+		vk::DescriptorSetLayout m_layout;
+		vk::DescriptorSet m_set;
+	};
 }
 
 #endif
@@ -7,11 +7,13 @@
  */
 
 #include "pch.hpp"
+#include "device.hpp"
 #include "context.hpp"
 
 #include <SDL_vulkan.h>
 
 #include "vkutl.hpp"
+#include "budget.hpp"
 #include "core/app.hpp"
 #include "swapchain.hpp"
 
@@ -41,8 +43,23 @@ static VKAPI_ATTR VkBool32 debug_callback(VkDebugUtilsMessageSeverityFlagBitsEXT
 
 namespace idio
 {
-	Context::Context(const Version &v, const std::string &appname, const Window &w)
+	constexpr size_t k_FrameArenaSize = 256 * 1024;
+	constexpr uint64_t k_BudgetCheckInterval = 600;
+	// Frames allowed to allocate while caches, pools and the like warm up
+	constexpr uint64_t k_HeapWarmupFrames = 16;
+	constexpr float k_StatsSmoothing = 0.05f;
+	constexpr uint64_t k_NoComputeFrame = std::numeric_limits<uint64_t>::max();
+
+	Context::Context(const Version &v, const std::string &appname, const Window &w, uint32_t maxFramesInFlight) :
+		m_framesInFlight(std::max(maxFramesInFlight, 1u)),
+		m_pendingFramesInFlight(m_framesInFlight),
+		m_frameStarts(m_framesInFlight),
+		m_slotFrames(m_framesInFlight),
+		m_computeSlotFrames(m_framesInFlight, k_NoComputeFrame),
+		m_frameArena(k_FrameArenaSize)
 	{
+		m_stats.framesInFlight = m_framesInFlight;
+
 		std::vector<const char *> vlayers;
 
 		// Instance
@@ -89,45 +106,60 @@ namespace idio
 
 		// Device
 		{
-			auto rawpdevs = m_instance.enumeratePhysicalDevices().value;
-			std::vector<PhysicalDevice> pdevs(rawpdevs.size());
-			std::copy(rawpdevs.begin(), rawpdevs.end(), pdevs.begin());
-			auto devit = std::max_element(pdevs.begin(), pdevs.end());
-			if(devit == pdevs.end() || devit->gfxQueueFamilyIdx == std::numeric_limits<uint32_t>::max()) {
-				s_EngineLogger->critical("No suitable graphics devices found.");
+			// Present support can only be checked against a surface, the swapchain makes its own later
+			VkSurfaceKHR rsurf;
+			if(!SDL_Vulkan_CreateSurface(w, m_instance, &rsurf)) {
+				s_EngineLogger->critical("Failed to create surface: {}", SDL_GetError());
 				Application::crash();
 			}
 
-			m_pdev = *devit;
+			m_pdev = select_physical_device(m_instance, rsurf);
+			m_instance.destroySurfaceKHR(rsurf);
 			s_EngineLogger->info("Selected GPU {}", m_pdev.props.deviceName);
 
 			constexpr float prior = 1.0f;
-			vk::DeviceQueueCreateInfo qci {};
-			qci.queueCount = 1;
-			qci.pQueuePriorities = &prior;
-			qci.queueFamilyIndex = m_pdev.gfxQueueFamilyIdx;
-
-			const std::vector<const char *> exts { VK_KHR_SWAPCHAIN_EXTENSION_NAME };
-			vk::DeviceCreateInfo ci {};
-			ci.queueCreateInfoCount = 1;
-			ci.pQueueCreateInfos = &qci;
-			ci.enabledLayerCount = static_cast<uint32_t>(vlayers.size());
-			ci.ppEnabledLayerNames = vlayers.data();
-			ci.enabledExtensionCount = static_cast<uint32_t>(exts.size());
-			ci.ppEnabledExtensionNames = exts.data();
-			m_device = check_vk(m_pdev.handle.createDevice(ci), "Failed to create device");
+			std::array<vk::DeviceQueueCreateInfo, 2> qcis {};
+			qcis[0].queueCount = 1;
+			qcis[0].pQueuePriorities = &prior;
+			qcis[0].queueFamilyIndex = m_pdev.gfxQueueFamilyIdx;
+			qcis[1] = qcis[0];
+			qcis[1].queueFamilyIndex = m_pdev.computeQueueFamilyIdx;
+			const uint32_t queueCount = has_async_compute() ? 2 : 1;
+			if(has_async_compute()) {
+				s_EngineLogger->info("Using async compute queue family {}", m_pdev.computeQueueFamilyIdx);
+			}
+
+			m_device = create_logical_device(m_pdev, std::span(qcis.data(), queueCount), vlayers);
+			m_dispatchLoader->init(m_device);
 			m_gfxQueue = m_device.getQueue(m_pdev.gfxQueueFamilyIdx, 0);
+			m_computeQueue = m_device.getQueue(m_pdev.computeQueueFamilyIdx, 0);
+			m_gfxBatch = std::make_unique<SubmitBatch>(*this, QueueType::Graphics);
+			m_computeBatch = std::make_unique<SubmitBatch>(*this, QueueType::Compute);
 		}
 
 		vk::SemaphoreCreateInfo sci {};
 		vk::FenceCreateInfo fci {};
 		fci.flags = vk::FenceCreateFlagBits::eSignaled;
-		for(uint32_t i = 0; i < s_MaxFramesProcessing; i++) {
+		m_gfxQueueFences.resize(m_framesInFlight);
+		m_gfxFinishSems.resize(m_framesInFlight);
+		m_computeFences.resize(m_framesInFlight);
+		for(uint32_t i = 0; i < m_framesInFlight; i++) {
 			m_gfxQueueFences[i] = check_vk(m_device.createFence(fci), "Failed to create render finished fence");
 			m_gfxFinishSems[i] = check_vk(m_device.createSemaphore(sci), "Failed to create gfx finish sem");
+			m_computeFences[i] = check_vk(m_device.createFence(fci), "Failed to create compute finished fence");
 		}
 
 		VmaAllocatorCreateInfo aci {};
+		// VMA loads the entry points of the version it's told, which 1.2 drivers don't have for 1.3
+		const uint32_t devVersion = VK_MAKE_API_VERSION(0, VK_API_VERSION_MAJOR(m_pdev.props.apiVersion),
+			VK_API_VERSION_MINOR(m_pdev.props.apiVersion), 0);
+		aci.vulkanApiVersion = std::min(devVersion, VK_API_VERSION_1_3);
+		if(m_pdev.features.memoryBudget) {
+			aci.flags |= VMA_ALLOCATOR_CREATE_EXT_MEMORY_BUDGET_BIT;
+		}
+		if(m_pdev.features.bufferDeviceAddress) {
+			aci.flags |= VMA_ALLOCATOR_CREATE_BUFFER_DEVICE_ADDRESS_BIT;
+		}
 		aci.device = m_device;
 		aci.instance = m_instance;
 		aci.physicalDevice = m_pdev.handle;
@@ -136,9 +168,11 @@ namespace idio
 
 	Context::~Context()
 	{
-		for(uint32_t i = 0; i < s_MaxFramesProcessing; i++) {
+		m_taskPool.reset();
+		for(size_t i = 0; i < m_gfxQueueFences.size(); i++) {
 			m_device.destroyFence(m_gfxQueueFences[i]);
 			m_device.destroySemaphore(m_gfxFinishSems[i]);
+			m_device.destroyFence(m_computeFences[i]);
 		}
 
 		vmaDestroyAllocator(m_alloc);
@@ -160,43 +194,422 @@ namespace idio
 		check_vk(buf.end(), "Failed to record cmd buf");
 	}
 
-	void Context::draw_cmd(vk::CommandBuffer buf, uint32_t vertCount) const
+	void Context::draw_cmd(vk::CommandBuffer buf, uint32_t vertCount, uint32_t instanceCount,
+		uint32_t firstVert, uint32_t firstInstance) const
+	{
+		buf.draw(vertCount, instanceCount, firstVert, firstInstance);
+		count_metric(EngineMetric::DrawCalls);
+	}
+
+	void Context::draw_indexed_cmd(vk::CommandBuffer buf, uint32_t indexCount, uint32_t instanceCount,
+		uint32_t firstIndex, int32_t vertexOffset, uint32_t firstInstance) const
+	{
+		buf.drawIndexed(indexCount, instanceCount, firstIndex, vertexOffset, firstInstance);
+		count_metric(EngineMetric::DrawCalls);
+	}
+
+	void Context::draw_indirect_cmd(vk::CommandBuffer buf, vk::Buffer cmds, vk::DeviceSize offset, uint32_t drawCount) const
+	{
+		constexpr uint32_t stride = sizeof(vk::DrawIndirectCommand);
+		if(m_pdev.features.multiDrawIndirect) {
+			buf.drawIndirect(cmds, offset, drawCount, stride);
+			count_metric(EngineMetric::DrawCalls);
+			return;
+		}
+
+		for(uint32_t i = 0; i < drawCount; i++) {
+			buf.drawIndirect(cmds, offset + i * stride, 1, stride);
+		}
+		count_metric(EngineMetric::DrawCalls, drawCount);
+	}
+
+	void Context::draw_indexed_indirect_cmd(vk::CommandBuffer buf, vk::Buffer cmds, vk::DeviceSize offset, uint32_t drawCount) const
+	{
+		constexpr uint32_t stride = sizeof(vk::DrawIndexedIndirectCommand);
+		if(m_pdev.features.multiDrawIndirect) {
+			buf.drawIndexedIndirect(cmds, offset, drawCount, stride);
+			count_metric(EngineMetric::DrawCalls);
+			return;
+		}
+
+		for(uint32_t i = 0; i < drawCount; i++) {
+			buf.drawIndexedIndirect(cmds, offset + i * stride, 1, stride);
+		}
+		count_metric(EngineMetric::DrawCalls, drawCount);
+	}
+
+	void Context::draw_indexed_indirect_count_cmd(vk::CommandBuffer buf, vk::Buffer cmds, vk::DeviceSize offset,
+		vk::Buffer count, vk::DeviceSize countOffset, uint32_t maxDraws) const
+	{
+		if(m_pdev.features.drawIndirectCount) {
+			buf.drawIndexedIndirectCount(cmds, offset, count, countOffset, maxDraws, sizeof(vk::DrawIndexedIndirectCommand));
+			count_metric(EngineMetric::DrawCalls);
+		} else {
+			draw_indexed_indirect_cmd(buf, cmds, offset, maxDraws);
+		}
+	}
+
+	void Context::begin_frame()
+	{
+		if(m_pendingFramesInFlight != m_framesInFlight) {
+			apply_frames_in_flight();
+		}
+
+		// Other frames are only polled, so their latency is sampled a frame late at worst
+		auto now = Clock::now();
+		for(uint32_t i = 0; i < m_framesInFlight; i++) {
+			if(i != m_frameIndex && m_frameStarts[i] != Clock::time_point {}
+				&& m_device.getFenceStatus(m_gfxQueueFences[i]) == vk::Result::eSuccess) {
+				retire_frame(i, now);
+			}
+		}
+
+		constexpr uint64_t intmax = std::numeric_limits<uint64_t>::max();
+		const auto waitStart = Clock::now();
+		check_vk(m_device.waitForFences(m_gfxQueueFences[m_frameIndex], true, intmax), "Got impatient");
+		now = Clock::now();
+		count_metric(EngineMetric::FenceWaitMicros,
+			static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(now - waitStart).count()));
+		if(m_frameStarts[m_frameIndex] != Clock::time_point {}) {
+			retire_frame(m_frameIndex, now);
+		}
+		retire_compute();
+
+		if(m_lastFrameStart != Clock::time_point {}) {
+			const std::chrono::duration<float, std::milli> dt = now - m_lastFrameStart;
+			m_stats.frameTime = m_stats.frames == 0 ? dt.count() : glm::mix(m_stats.frameTime, dt.count(), k_StatsSmoothing);
+			m_stats.frames++;
+		}
+
+		m_lastFrameStart = now;
+
+		m_frameArena.reset();
+		vmaSetCurrentFrameIndex(m_alloc, static_cast<uint32_t>(m_frameNumber)); // Refreshes the memory budget
+		m_frameStartHeapAllocs = heap_allocation_count();
+	}
+
+	void Context::end_frame()
+	{
+		m_frameHeapAllocs = heap_allocation_count() - m_frameStartHeapAllocs;
+		count_metric(EngineMetric::HeapAllocations, m_frameHeapAllocs);
+		set_metric(EngineMetric::FrameTime, static_cast<double>(m_stats.frameTime));
+		set_metric(EngineMetric::FrameLatency, static_cast<double>(m_stats.latency));
+		collect_metrics(m_frameNumber);
+		if constexpr(ID_DEBUG) {
+			if(m_frameHeapAllocs != 0 && m_frameNumber >= k_HeapWarmupFrames) {
+				s_EngineLogger->trace("Frame {} made {} heap allocations", m_frameNumber, m_frameHeapAllocs);
+			}
+		}
+
+		if(m_frameNumber % k_BudgetCheckInterval == 0) {
+			auto stats = query_memory_stats(*this);
+			if(stats.is_over_budget()) {
+				s_EngineLogger->warn("Gpu memory is close to the budget");
+				log_memory_stats(stats);
+			}
+		}
+
+		m_frameNumber++;
+		m_frameIndex = (m_frameIndex + 1) % m_framesInFlight;
+	}
+
+	void Context::set_frames_in_flight(uint32_t count)
+	{
+		m_pendingFramesInFlight = std::clamp(count, 1u, get_max_frames_in_flight());
+	}
+
+	void Context::apply_frames_in_flight()
+	{
+		s_EngineLogger->info("{} frames in flight: {:.2f}ms per frame, {:.2f}ms latency over {} frames",
+			m_stats.framesInFlight, m_stats.frameTime, m_stats.latency, m_stats.frames);
+
+		// Per-frame resources are indexed by frame index, none of them can be in use when it wraps differently
+		check_vk(m_device.waitIdle(), "Failed to drain frames in flight");
+		m_framesInFlight = m_pendingFramesInFlight;
+		m_frameIndex = 0;
+		m_framesCompleted = m_frameNumber;
+		m_computeCompleted = m_frameNumber;
+		std::fill(m_computeSlotFrames.begin(), m_computeSlotFrames.end(), k_NoComputeFrame);
+
+		m_stats = FrameStats {};
+		m_stats.framesInFlight = m_framesInFlight;
+		m_lastFrameStart = {};
+		std::fill(m_frameStarts.begin(), m_frameStarts.end(), Clock::time_point {});
+	}
+
+	void Context::retire_frame(uint32_t frameIndex, Clock::time_point now)
+	{
+		// A queue finishes its submissions in order, so everything before this frame is done too
+		m_framesCompleted = std::max(m_framesCompleted, m_slotFrames[frameIndex] + 1);
+
+		const std::chrono::duration<float, std::milli> latency = now - m_frameStarts[frameIndex];
+		m_stats.latency = m_stats.latency == 0.0f ? latency.count() : glm::mix(m_stats.latency, latency.count(), k_StatsSmoothing);
+		m_frameStarts[frameIndex] = {};
+	}
+
+	void Context::retire_compute()
+	{
+		constexpr uint64_t intmax = std::numeric_limits<uint64_t>::max();
+		bool pending = false;
+		for(uint32_t i = 0; i < m_framesInFlight; i++) {
+			if(m_computeSlotFrames[i] == k_NoComputeFrame) {
+				continue;
+			}
+
+			// This frame index's fence gets reset by the coming flush, so it has to be waited for
+			if(i == m_frameIndex) {
+				check_vk(m_device.waitForFences(m_computeFences[i], true, intmax), "Got impatient on compute");
+			} else if(m_device.getFenceStatus(m_computeFences[i]) != vk::Result::eSuccess) {
+				pending = true;
+				continue;
+			}
+
+			m_computeCompleted = std::max(m_computeCompleted, m_computeSlotFrames[i] + 1);
+			m_computeSlotFrames[i] = k_NoComputeFrame;
+		}
+
+		// Frames that enqueued no compute are complete once everything before them is
+		if(!pending) {
+			m_computeCompleted = m_frameNumber;
+		}
+	}
+
+	void Context::enqueue_gfx(std::span<const vk::CommandBuffer> cbufs, std::span<const SemaphoreWait> waits,
+		std::span<const SemaphoreSignal> signals)
 	{
-		buf.draw(vertCount, 1, 0, 0);
+		check_frame_thread("enqueue_gfx");
+		m_gfxBatch->enqueue(cbufs, waits, signals);
 	}
 
-	void Context::submit_gfx_queue(const std::vector<vk::CommandBuffer> &cbufs, vk::Fence fence)
+	void Context::enqueue_compute(std::span<const vk::CommandBuffer> cbufs, std::span<const SemaphoreWait> waits,
+		std::span<const SemaphoreSignal> signals)
 	{
-		vk::SubmitInfo si {};
-		si.commandBufferCount = static_cast<uint32_t>(cbufs.size());
-		si.pCommandBuffers = cbufs.data();
-		check_vk(m_gfxQueue.submit(si, fence), "Failed to submit gfx");
+		check_frame_thread("enqueue_compute");
+		m_computeBatch->enqueue(cbufs, waits, signals);
+	}
+
+	void Context::enqueue_frame(std::span<Swapchain *const> scs, std::span<const vk::CommandBuffer> cbufs,
+		std::span<const vk::Semaphore> computeWaits)
+	{
+		check_frame_thread("enqueue_frame");
+		using enum vk::PipelineStageFlagBits2;
+		auto waits = m_frameArena.alloc<SemaphoreWait>(scs.size() + computeWaits.size());
+		for(size_t i = 0; i < scs.size(); i++) {
+			waits[i] = { scs[i]->get_current_image_avail_sem(), eColorAttachmentOutput };
+		}
+
+		for(size_t i = 0; i < computeWaits.size(); i++) {
+			waits[scs.size() + i] = { computeWaits[i], eDrawIndirect | eComputeShader };
+		}
+
+		const SemaphoreSignal sig { m_gfxFinishSems[m_frameIndex], eAllCommands };
+		m_gfxBatch->enqueue(cbufs, waits, std::span(&sig, 1));
 	}
 
-	void Context::submit_gfx_queue(const Swapchain &sc, const std::vector<vk::CommandBuffer> &cbufs)
+	void Context::flush_submits()
 	{
-		auto fi = sc.get_current_frame_index();
-		const vk::Semaphore sigs[] = { m_gfxFinishSems[fi] };
-		const vk::Semaphore imgav[] = { sc.get_current_image_avail_sem() };
-		const vk::PipelineStageFlags waitstage[] = { vk::PipelineStageFlagBits::eColorAttachmentOutput };
+		check_frame_thread("flush_submits");
+		if(!m_computeBatch->empty()) {
+			// begin_frame already waited for this fence's previous submission
+			check_vk(m_device.resetFences(m_computeFences[m_frameIndex]), "Failed to reset compute fence");
+			m_computeBatch->flush(m_computeFences[m_frameIndex]);
+			m_computeSlotFrames[m_frameIndex] = m_frameNumber;
+		}
+
+		if(m_gfxBatch->empty()) {
+			return;
+		}
+
+		// Only alongside other work, so the frame fence covers what the tasks recorded
+		{
+			std::lock_guard lock(m_taskMutex);
+			if(!m_frameTasks.empty()) {
+				auto cmd = m_taskCmds[m_frameIndex];
+				check_vk(cmd.reset(), "Failed to reset frame task buffer");
+				begin_cmd(cmd);
+				for(auto &[id, task] : m_frameTasks) {
+					task(cmd);
+				}
+				end_cmd(cmd);
+				m_gfxBatch->enqueue(std::span(&cmd, 1));
+			}
+		}
+
+		// Reset only once there's work to signal it again, a frame that never submits can't deadlock the next
+		check_vk(m_device.resetFences(m_gfxQueueFences[m_frameIndex]), "Failed to reset frame fence");
+		m_gfxBatch->flush(m_gfxQueueFences[m_frameIndex]);
+		m_frameStarts[m_frameIndex] = m_lastFrameStart;
+		m_slotFrames[m_frameIndex] = m_frameNumber;
+	}
+
+
+	FrameTaskId Context::add_frame_task(FrameTask &&task)
+	{
+		std::lock_guard lock(m_taskMutex);
+		if(!m_taskPool) {
+			m_taskPool = std::make_unique<CommandPool>(*this);
+			m_taskCmds = m_taskPool->get_buffers(get_max_frames_in_flight());
+		}
+
+		m_frameTasks.emplace_back(m_nextFrameTask, std::move(task));
+		return m_nextFrameTask++;
+	}
+
+	void Context::remove_frame_task(FrameTaskId id)
+	{
+		std::lock_guard lock(m_taskMutex);
+		std::erase_if(m_frameTasks, [id](const std::pair<FrameTaskId, FrameTask> &t) { return t.first == id; });
+	}
+
+	void Context::check_frame_thread(std::string_view what) const
+	{
+		if constexpr(ID_DEBUG) {
+			const auto owner = m_frameThread.load();
+			if(owner != std::thread::id {} && owner != std::this_thread::get_id()) {
+				s_EngineLogger->critical("{} called off the frame thread, it belongs in render_packet or tick", what);
+				Application::crash();
+			}
+		}
+	}
+
+
+	SubmitBatch::SubmitBatch(const Context &c, QueueType q) :
+		m_queue(q == QueueType::Compute ? c.get_compute_queue() : c.get_gfx_queue()),
+		m_sync2(c.get_features().synchronization2),
+		m_core13(c.get_physdev().props.apiVersion >= VK_API_VERSION_1_3),
+		m_timeline(c.get_features().timelineSemaphores),
+		m_dispatch(c.get_dispatch())
+	{}
+
+	void SubmitBatch::enqueue(std::span<const vk::CommandBuffer> cbufs, std::span<const SemaphoreWait> waits,
+		std::span<const SemaphoreSignal> signals)
+	{
+		Submit s {};
+		s.firstCmd = static_cast<uint32_t>(m_cmds.size());
+		s.cmdCount = static_cast<uint32_t>(cbufs.size());
+		s.firstWait = static_cast<uint32_t>(m_waits.size());
+		s.waitCount = static_cast<uint32_t>(waits.size());
+		s.firstSignal = static_cast<uint32_t>(m_signals.size());
+		s.signalCount = static_cast<uint32_t>(signals.size());
+		m_submits.push_back(s);
+
+		m_cmds.insert(m_cmds.end(), cbufs.begin(), cbufs.end());
+		m_waits.insert(m_waits.end(), waits.begin(), waits.end());
+		m_signals.insert(m_signals.end(), signals.begin(), signals.end());
+	}
+
+	bool SubmitBatch::flush(vk::Fence fence)
+	{
+		if(m_submits.empty()) {
+			return false;
+		}
+
+		if(m_sync2) {
+			flush2(fence);
+		} else {
+			flush1(fence);
+		}
+
+		count_metric(EngineMetric::Submits);
+		m_submits.clear();
+		m_cmds.clear();
+		m_waits.clear();
+		m_signals.clear();
+		return true;
+	}
+
+	void SubmitBatch::flush2(vk::Fence fence)
+	{
+		m_cmdInfos.clear();
+		m_semInfos.clear();
+		m_infos2.clear();
+		for(auto cmd : m_cmds) {
+			m_cmdInfos.emplace_back(cmd);
+		}
+
+		for(auto &w : m_waits) {
+			m_semInfos.emplace_back(w.semaphore, w.value, w.stages);
+		}
+
+		for(auto &sig : m_signals) {
+			m_semInfos.emplace_back(sig.semaphore, sig.value, sig.stages);
+		}
+
+		// Pointers are only taken once nothing else will be appended
+		const uint32_t signalBase = static_cast<uint32_t>(m_waits.size());
+		for(auto &s : m_submits) {
+			vk::SubmitInfo2 si {};
+			si.waitSemaphoreInfoCount = s.waitCount;
+			si.pWaitSemaphoreInfos = m_semInfos.data() + s.firstWait;
+			si.commandBufferInfoCount = s.cmdCount;
+			si.pCommandBufferInfos = m_cmdInfos.data() + s.firstCmd;
+			si.signalSemaphoreInfoCount = s.signalCount;
+			si.pSignalSemaphoreInfos = m_semInfos.data() + signalBase + s.firstSignal;
+			m_infos2.push_back(si);
+		}
+
+		if(m_core13) {
+			check_vk(m_queue.submit2(m_infos2, fence), "Failed to submit");
+		} else {
+			check_vk(m_queue.submit2KHR(m_infos2, fence, m_dispatch), "Failed to submit");
+		}
+	}
+
+	void SubmitBatch::flush1(vk::Fence fence)
+	{
+		// Without synchronization2 stage masks only have the low 32 bits
+		m_sems.clear();
+		m_values.clear();
+		m_waitStages.clear();
+		m_infos.clear();
+		m_timelineInfos.clear();
+		for(auto &w : m_waits) {
+			m_sems.push_back(w.semaphore);
+			m_values.push_back(w.value);
+			m_waitStages.push_back(vk::PipelineStageFlags(static_cast<VkPipelineStageFlags>(
+				static_cast<VkPipelineStageFlags2>(w.stages))));
+		}
+
+		for(auto &sig : m_signals) {
+			m_sems.push_back(sig.semaphore);
+			m_values.push_back(sig.value);
+		}
+
+		const uint32_t signalBase = static_cast<uint32_t>(m_waits.size());
+		for(auto &s : m_submits) {
+			vk::TimelineSemaphoreSubmitInfo ti {};
+			ti.waitSemaphoreValueCount = s.waitCount;
+			ti.pWaitSemaphoreValues = m_values.data() + s.firstWait;
+			ti.signalSemaphoreValueCount = s.signalCount;
+			ti.pSignalSemaphoreValues = m_values.data() + signalBase + s.firstSignal;
+			m_timelineInfos.push_back(ti);
+
+			vk::SubmitInfo si {};
+			si.waitSemaphoreCount = s.waitCount;
+			si.pWaitSemaphores = m_sems.data() + s.firstWait;
+			si.pWaitDstStageMask = m_waitStages.data() + s.firstWait;
+			si.commandBufferCount = s.cmdCount;
+			si.pCommandBuffers = m_cmds.data() + s.firstCmd;
+			si.signalSemaphoreCount = s.signalCount;
+			si.pSignalSemaphores = m_sems.data() + signalBase + s.firstSignal;
+			m_infos.push_back(si);
+		}
+
+		if(m_timeline) {
+			for(size_t i = 0; i < m_infos.size(); i++) {
+				m_infos[i].pNext = &m_timelineInfos[i];
+			}
+		}
 
-		vk::SubmitInfo si {};
-		si.waitSemaphoreCount = 1;
-		si.pWaitSemaphores = imgav;
-		si.pWaitDstStageMask = waitstage;
-		si.commandBufferCount = static_cast<uint32_t>(cbufs.size());
-		si.pCommandBuffers = cbufs.data();
-		si.signalSemaphoreCount = 1;
-		si.pSignalSemaphores = sigs;
-		check_vk(m_gfxQueue.submit(si, m_gfxQueueFences[fi]), "Failed to submit gfx");
+		check_vk(m_queue.submit(m_infos, fence), "Failed to submit");
 	}
 
 
-	CommandPool::CommandPool(const Context &c, bool transient) :
+	CommandPool::CommandPool(const Context &c, bool transient, QueueType q) :
 		m_dev(c.get_device())
 	{
 		vk::CommandPoolCreateInfo ci {};
-		ci.queueFamilyIndex = c.get_physdev().gfxQueueFamilyIdx;
+		ci.queueFamilyIndex = c.get_queue_family(q);
 		ci.flags = vk::CommandPoolCreateFlagBits::eResetCommandBuffer;
 		if(transient) {
 			ci.flags |= vk::CommandPoolCreateFlagBits::eTransient;
@@ -14,93 +14,222 @@ namespace idio
 	class Window;
 	class Pipeline;
 	class Swapchain;
+	class SubmitBatch;
+	class CommandPool;
 
-	constexpr const uint32_t s_MaxFramesProcessing = 3;
+	// Gpu upkeep (buffer pool compaction and the like) recorded by the engine every frame
+	using FrameTask = std::function<void(vk::CommandBuffer cmd)>;
+	using FrameTaskId = uint64_t;
 
-	struct PhysicalDevice
+	enum class QueueType
 	{
-		vk::PhysicalDevice handle = nullptr;
-		vk::PhysicalDeviceProperties props {};
-		vk::PhysicalDeviceFeatures supportedFeatures {};
-		uint32_t gfxQueueFamilyIdx = std::numeric_limits<uint32_t>::max();
-
-		PhysicalDevice() = default;
-		PhysicalDevice(vk::PhysicalDevice pdev) :
-			handle(pdev),
-			props(handle.getProperties()),
-			supportedFeatures(handle.getFeatures())
-		{
-			auto qfprops = handle.getQueueFamilyProperties();
-			uint32_t i = 0;
-			for(const auto &qfp : qfprops) {
-				if(qfp.queueCount == 0) {
-					i++;
-					continue;
-				}
-
-				if(qfp.queueFlags & vk::QueueFlagBits::eGraphics) {
-					gfxQueueFamilyIdx = i;
-				}
-
-				i++;
-			}
-		}
+		Graphics,
+		Compute
+	};
 
-		constexpr bool operator<(const PhysicalDevice &other) const noexcept
-		{
-			constexpr auto uintmax = std::numeric_limits<uint32_t>::max();
-			if(gfxQueueFamilyIdx == uintmax && other.gfxQueueFamilyIdx != uintmax) {
-				return true;
-			}
+	struct SemaphoreWait
+	{
+		vk::Semaphore semaphore;
+		vk::PipelineStageFlags2 stages = vk::PipelineStageFlagBits2::eAllCommands;
+		uint64_t value = 0; // Timeline semaphores only
+	};
 
-			if(other.props.deviceType == vk::PhysicalDeviceType::eCpu) {
-				return false;
-			}
+	struct SemaphoreSignal
+	{
+		vk::Semaphore semaphore;
+		vk::PipelineStageFlags2 stages = vk::PipelineStageFlagBits2::eAllCommands;
+		uint64_t value = 0;
+	};
 
-			return (other.props.deviceType == vk::PhysicalDeviceType::eDiscreteGpu);
-		}
+	// Measured for the current frames in flight setting, and reset whenever it changes
+	struct FrameStats
+	{
+		uint32_t framesInFlight = 0;
+		uint64_t frames = 0;
+		float frameTime = 0.0f; // Smoothed ms between frame starts, the inverse of throughput
+		float latency = 0.0f;   // Smoothed ms from a frame starting on the cpu to its gpu work finishing
 	};
 
 	class Context
 	{
 	public:
-		Context(const Version &v, const std::string &appname, const Window &w);
+		// Every per-frame resource is sized for maxFramesInFlight, which is also the initial setting
+		Context(const Version &v, const std::string &appname, const Window &w,
+			uint32_t maxFramesInFlight = s_DefaultFramesInFlight);
 		~Context();
 
 		void begin_cmd(vk::CommandBuffer buf) const;
 		void end_cmd(vk::CommandBuffer buf) const;
-		void draw_cmd(vk::CommandBuffer buf, uint32_t vertCount) const;
-
-		void submit_gfx_queue(const std::vector<vk::CommandBuffer> &cbufs, vk::Fence fence);
-		void submit_gfx_queue(const Swapchain &sc, const std::vector<vk::CommandBuffer> &cbufs);
+		void draw_cmd(vk::CommandBuffer buf, uint32_t vertCount, uint32_t instanceCount = 1,
+			uint32_t firstVert = 0, uint32_t firstInstance = 0) const;
+		void draw_indexed_cmd(vk::CommandBuffer buf, uint32_t indexCount, uint32_t instanceCount = 1,
+			uint32_t firstIndex = 0, int32_t vertexOffset = 0, uint32_t firstInstance = 0) const;
+
+		// Indirect draws read tightly packed vk::Draw(Indexed)IndirectCommands from cmds
+		void draw_indirect_cmd(vk::CommandBuffer buf, vk::Buffer cmds, vk::DeviceSize offset, uint32_t drawCount) const;
+		void draw_indexed_indirect_cmd(vk::CommandBuffer buf, vk::Buffer cmds, vk::DeviceSize offset, uint32_t drawCount) const;
+		// Without driver support for drawIndirectCount all maxDraws commands are issued,
+		// so unused ones must have an instanceCount of zero
+		void draw_indexed_indirect_count_cmd(vk::CommandBuffer buf, vk::Buffer cmds, vk::DeviceSize offset,
+			vk::Buffer count, vk::DeviceSize countOffset, uint32_t maxDraws) const;
+
+		// Work is only handed to the driver by flush_submits, once per queue at the end of the frame.
+		// Enqueueing and flushing belong to the frame thread, see set_frame_thread.
+		// Everything enqueued on the graphics queue has finished once is_frame_complete(frame number at enqueue),
+		// and everything enqueued on the compute queue once is_compute_complete(frame number at enqueue).
+		void enqueue_gfx(std::span<const vk::CommandBuffer> cbufs, std::span<const SemaphoreWait> waits = {},
+			std::span<const SemaphoreSignal> signals = {});
+		void enqueue_compute(std::span<const vk::CommandBuffer> cbufs, std::span<const SemaphoreWait> waits = {},
+			std::span<const SemaphoreSignal> signals = {});
+		// The frame's rendering, waiting on every swapchain it renders to, made through Application::submit_frame.
+		// computeWaits are semaphores signalled by enqueue_compute that this frame consumes.
+		void enqueue_frame(std::span<Swapchain *const> scs, std::span<const vk::CommandBuffer> cbufs,
+			std::span<const vk::Semaphore> computeWaits = {});
+		// Compute goes first so the graphics queue never waits on a signal that hasn't been submitted.
+		// Frame tasks are recorded into one command buffer that runs after the rest of the frame's graphics work.
+		void flush_submits();
+		// Safe from any thread, removing waits for a flush that is running the task
+		FrameTaskId add_frame_task(FrameTask &&task);
+		void remove_frame_task(FrameTaskId id);
+		bool is_frame_complete(uint64_t frameNumber) const noexcept { return frameNumber < m_framesCompleted; }
+		// Compute has its own fence per frame index, so async work no graphics waits on can still be retired
+		bool is_compute_complete(uint64_t frameNumber) const noexcept { return frameNumber < m_computeCompleted; }
+
+		// Frame boundaries, driven by Application::run. The arena is reset at the start of every frame.
+		// begin_frame waits until the gpu has finished the frame that last used this frame index, on both queues.
+		void begin_frame();
+		void end_frame();
+		// Takes effect at the next begin_frame, which drains the gpu first. Clamped to [1, max].
+		void set_frames_in_flight(uint32_t count);
+		uint32_t get_frames_in_flight() const noexcept { return m_framesInFlight; }
+		uint32_t get_max_frames_in_flight() const noexcept { return static_cast<uint32_t>(m_gfxQueueFences.size()); }
+		const FrameStats &get_frame_stats() const noexcept { return m_stats; }
+		uint32_t get_frame_index() const noexcept { return m_frameIndex; }
+		uint64_t get_frame_number() const noexcept { return m_frameNumber; }
+		LinearArena &get_frame_arena() noexcept { return m_frameArena; }
+		uint64_t get_frame_heap_allocations() const noexcept { return m_frameHeapAllocs; }
+		// The thread that owns submissions and other per-frame state, set by Application::run while a render
+		// thread is running. Unset lets any thread in, which covers init() and single threaded apps.
+		void set_frame_thread(std::thread::id id) noexcept { m_frameThread = id; }
+		// Debug builds crash when called from anything but the frame thread
+		void check_frame_thread(std::string_view what) const;
 
 		vk::Instance get_instance() const noexcept { return m_instance; }
 		vk::Device get_device() const noexcept { return m_device; }
-		PhysicalDevice get_physdev() const noexcept { return m_pdev; }
+		const PhysicalDevice &get_physdev() const noexcept { return m_pdev; }
+		// Optional features that were enabled, see DeviceFeatures
+		const DeviceFeatures &get_features() const noexcept { return m_pdev.features; }
 		VmaAllocator get_allocator() const noexcept { return m_alloc; }
+		// For extension entry points that aren't in the static loader
+		const vk::DispatchLoaderDynamic &get_dispatch() const noexcept { return *m_dispatchLoader; }
 
 		vk::Queue get_gfx_queue() const noexcept { return m_gfxQueue; }
-		auto get_gfx_queue_finish_sems() const noexcept { return m_gfxFinishSems; }
-		auto get_gfx_queue_fences() const noexcept { return m_gfxQueueFences; }
+		vk::Queue get_compute_queue() const noexcept { return m_computeQueue; }
+		bool has_async_compute() const noexcept { return m_pdev.computeQueueFamilyIdx != m_pdev.gfxQueueFamilyIdx; }
+		uint32_t get_queue_family(QueueType q) const noexcept
+		{
+			return q == QueueType::Compute ? m_pdev.computeQueueFamilyIdx : m_pdev.gfxQueueFamilyIdx;
+		}
+
+		std::span<const vk::Semaphore> get_gfx_queue_finish_sems() const noexcept { return m_gfxFinishSems; }
+		std::span<const vk::Fence> get_gfx_queue_fences() const noexcept { return m_gfxQueueFences; }
 	private:
 		vk::Instance m_instance;
 		std::unique_ptr<vk::DispatchLoaderDynamic> m_dispatchLoader;
 		PhysicalDevice m_pdev;
 		vk::Device m_device;
 		vk::Queue m_gfxQueue;
-		std::array<vk::Fence, s_MaxFramesProcessing> m_gfxQueueFences;
-		std::array<vk::Semaphore, s_MaxFramesProcessing> m_gfxFinishSems;
+		vk::Queue m_computeQueue;
+		std::vector<vk::Fence> m_gfxQueueFences;
+		std::vector<vk::Semaphore> m_gfxFinishSems;
+		std::vector<vk::Fence> m_computeFences;
 		VmaAllocator m_alloc;
+		std::unique_ptr<SubmitBatch> m_gfxBatch;
+		std::unique_ptr<SubmitBatch> m_computeBatch;
+
+		std::atomic<std::thread::id> m_frameThread {};
+		std::mutex m_taskMutex; // Guards the frame task list, pools come and go on the main thread
+		std::vector<std::pair<FrameTaskId, FrameTask>> m_frameTasks;
+		FrameTaskId m_nextFrameTask = 1;
+		std::unique_ptr<CommandPool> m_taskPool; // Created with the first task
+		std::vector<vk::CommandBuffer> m_taskCmds;
+
+		uint32_t m_framesInFlight;
+		uint32_t m_pendingFramesInFlight;
+		FrameStats m_stats;
+		Clock::time_point m_lastFrameStart {};
+		std::vector<Clock::time_point> m_frameStarts; // Per frame index, empty once its latency was sampled
+		std::vector<uint64_t> m_slotFrames; // Frame number last submitted with each frame index's fence
+		uint64_t m_framesCompleted = 0;
+		std::vector<uint64_t> m_computeSlotFrames; // Frame number of the compute flush pending on each fence, if any
+		uint64_t m_computeCompleted = 0;
+
+		uint32_t m_frameIndex = 0;
+		uint64_t m_frameNumber = 0;
+		LinearArena m_frameArena;
+		uint64_t m_frameStartHeapAllocs = 0;
+		uint64_t m_frameHeapAllocs = 0;
+
+		void apply_frames_in_flight();
+		void retire_frame(uint32_t frameIndex, Clock::time_point now);
+		void retire_compute();
 
 #if ID_DEBUG
 		vk::DebugUtilsMessengerEXT m_dbgmsgr;
 #endif
 	};
 
+	// Collects a queue's submissions and hands them to the driver in one call, vkQueueSubmit2
+	// with synchronization2 and vkQueueSubmit otherwise. They execute in the order enqueued.
+	class SubmitBatch
+	{
+	public:
+		SubmitBatch(const Context &c, QueueType q);
+		SubmitBatch(const SubmitBatch &o) = delete;
+		SubmitBatch &operator=(const SubmitBatch &o) = delete;
+
+		void enqueue(std::span<const vk::CommandBuffer> cbufs, std::span<const SemaphoreWait> waits = {},
+			std::span<const SemaphoreSignal> signals = {});
+		// The fence may be null, false when there was nothing to submit
+		bool flush(vk::Fence fence);
+		bool empty() const noexcept { return m_submits.empty(); }
+	private:
+		struct Submit
+		{
+			uint32_t firstCmd, cmdCount;
+			uint32_t firstWait, waitCount;
+			uint32_t firstSignal, signalCount;
+		};
+
+		vk::Queue m_queue;
+		bool m_sync2;
+		bool m_core13;
+		bool m_timeline;
+		const vk::DispatchLoaderDynamic &m_dispatch;
+
+		std::vector<Submit> m_submits;
+		std::vector<vk::CommandBuffer> m_cmds;
+		std::vector<SemaphoreWait> m_waits;
+		std::vector<SemaphoreSignal> m_signals;
+
+		// Scratch for building the submit call, kept around so flushing doesn't allocate
+		std::vector<vk::SubmitInfo2> m_infos2;
+		std::vector<vk::CommandBufferSubmitInfo> m_cmdInfos;
+		std::vector<vk::SemaphoreSubmitInfo> m_semInfos;
+		std::vector<vk::SubmitInfo> m_infos;
+		std::vector<vk::TimelineSemaphoreSubmitInfo> m_timelineInfos;
+		std::vector<vk::Semaphore> m_sems;
+		std::vector<uint64_t> m_values;
+		std::vector<vk::PipelineStageFlags> m_waitStages;
+
+		void flush2(vk::Fence fence);
+		void flush1(vk::Fence fence);
+	};
+
 	class CommandPool
 	{
 	public:
-		explicit CommandPool(const Context &c, bool transient = false);
+		explicit CommandPool(const Context &c, bool transient = false, QueueType q = QueueType::Graphics);
 		~CommandPool();
 
 		void reset();
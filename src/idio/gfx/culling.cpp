@@ -0,0 +1,177 @@
+/**
+ * Copyright (c) 2022 Connor Mellon
+ * 
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+#include "pch.hpp"
+#include "buffer.hpp"
+#include "pipeline.hpp"
+#include "culling.hpp"
+
+#include "vkutl.hpp"
+#include "device.hpp"
+#include "context.hpp"
+
+namespace idio
+{
+	namespace
+	{
+		constexpr uint32_t k_CullGroupSize = 64;
+
+		struct CullConstants
+		{
+			std::array<glm::vec4, 6> planes;
+			uint32_t objectCount;
+			uint32_t compact;
+		};
+	}
+
+	Frustum Frustum::from_matrix(const glm::mat4 &m)
+	{
+		auto row = [&](int i) { return glm::vec4(m[0][i], m[1][i], m[2][i], m[3][i]); };
+
+		Frustum f {};
+		f.planes[0] = row(3) + row(0); // Left
+		f.planes[1] = row(3) - row(0); // Right
+		f.planes[2] = row(3) + row(1); // Bottom
+		f.planes[3] = row(3) - row(1); // Top
+		f.planes[4] = row(2);          // Near (0..1 depth)
+		f.planes[5] = row(3) - row(2); // Far
+		for(auto &p : f.planes) {
+			p /= glm::length(glm::vec3(p));
+		}
+
+		return f;
+	}
+
+
+	GpuCuller::GpuCuller(const Context &c, uint32_t maxObjects, const std::string &shaderPath) :
+		m_context(c), m_maxObjects(maxObjects)
+	{
+		if(!c.get_features().drawIndirectFirstInstance) {
+			s_EngineLogger->warn("drawIndirectFirstInstance unsupported, culled draws lose their object index");
+		}
+
+		m_objects = std::make_unique<StorageBuffer<BufferUse::Gpu>>(c, sizeof(CullObject) * maxObjects);
+		m_draws = std::make_unique<IndirectStorageBuffer>(c, sizeof(vk::DrawIndexedIndirectCommand) * maxObjects);
+		m_count = std::make_unique<IndirectStorageBuffer>(c, sizeof(uint32_t));
+
+		std::array<vk::DescriptorSetLayoutBinding, 3> bindings {};
+		for(uint32_t i = 0; i < bindings.size(); i++) {
+			bindings[i].binding = i;
+			bindings[i].descriptorCount = 1;
+			bindings[i].descriptorType = vk::DescriptorType::eStorageBuffer;
+			bindings[i].stageFlags = vk::ShaderStageFlagBits::eCompute;
+		}
+
+		vk::DescriptorSetLayoutCreateInfo lci {};
+		lci.bindingCount = static_cast<uint32_t>(bindings.size());
+		lci.pBindings = bindings.data();
+		m_layout = check_vk(c.get_device().createDescriptorSetLayout(lci), "Failed to create cull layout");
+
+		vk::DescriptorPoolSize psz { vk::DescriptorType::eStorageBuffer, static_cast<uint32_t>(bindings.size()) };
+		vk::DescriptorPoolCreateInfo pci {};
+		pci.maxSets = 1;
+		pci.poolSizeCount = 1;
+		pci.pPoolSizes = &psz;
+		m_pool = check_vk(c.get_device().createDescriptorPool(pci), "Failed to create cull pool");
+
+		vk::DescriptorSetAllocateInfo dai {};
+		dai.descriptorPool = m_pool;
+		dai.descriptorSetCount = 1;
+		dai.pSetLayouts = &m_layout;
+		m_set = check_vk(c.get_device().allocateDescriptorSets(dai), "Failed to allocate cull set")[0];
+
+		const std::array<vk::DescriptorBufferInfo, 3> dbis {
+			vk::DescriptorBufferInfo { *m_objects, 0, VK_WHOLE_SIZE },
+			vk::DescriptorBufferInfo { *m_draws, 0, VK_WHOLE_SIZE },
+			vk::DescriptorBufferInfo { *m_count, 0, VK_WHOLE_SIZE }
+		};
+
+		std::array<vk::WriteDescriptorSet, 3> writes {};
+		for(uint32_t i = 0; i < writes.size(); i++) {
+			writes[i].dstSet = m_set;
+			writes[i].dstBinding = i;
+			writes[i].descriptorCount = 1;
+			writes[i].descriptorType = vk::DescriptorType::eStorageBuffer;
+			writes[i].pBufferInfo = &dbis[i];
+		}
+		c.get_device().updateDescriptorSets(writes, nullptr);
+
+		auto code = load_shader_from_disk(shaderPath);
+		if(!code) {
+			s_EngineLogger->critical("Missing culling shader");
+			Application::crash();
+		}
+
+		ComputePipelineCreateInfo cpci {};
+		cpci.shaderCode = *code;
+		cpci.setLayouts = { m_layout };
+		cpci.pushConstantRanges = {
+			vk::PushConstantRange { vk::ShaderStageFlagBits::eCompute, 0, sizeof(CullConstants) }
+		};
+		m_pipeline = std::make_unique<ComputePipeline>(c.get_device(), cpci);
+	}
+
+	GpuCuller::~GpuCuller()
+	{
+		m_context.get_device().destroyDescriptorPool(m_pool);
+		m_context.get_device().destroyDescriptorSetLayout(m_layout);
+	}
+
+	void GpuCuller::upload_objects_cmd(vk::CommandBuffer cmd, StorageBuffer<BufferUse::Staging> &src, uint32_t count)
+	{
+		m_objectCount = std::min(count, m_maxObjects);
+
+		// The previous cull may still be reading the objects
+		cmd.pipelineBarrier(vk::PipelineStageFlagBits::eComputeShader, vk::PipelineStageFlagBits::eTransfer,
+			{}, nullptr, nullptr, nullptr);
+		m_objects->copy_from(cmd, src, sizeof(CullObject) * m_objectCount, 0, 0);
+
+		vk::MemoryBarrier mb {};
+		mb.srcAccessMask = vk::AccessFlagBits::eTransferWrite;
+		mb.dstAccessMask = vk::AccessFlagBits::eShaderRead;
+		cmd.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eComputeShader,
+			{}, mb, nullptr, nullptr);
+	}
+
+	void GpuCuller::cull_cmd(vk::CommandBuffer cmd, const Frustum &f)
+	{
+		// Last frame's draws must be consumed before the outputs are rewritten
+		cmd.pipelineBarrier(vk::PipelineStageFlagBits::eDrawIndirect,
+			vk::PipelineStageFlagBits::eTransfer | vk::PipelineStageFlagBits::eComputeShader,
+			{}, nullptr, nullptr, nullptr);
+		cmd.fillBuffer(*m_count, 0, sizeof(uint32_t), 0);
+
+		vk::MemoryBarrier clear {};
+		clear.srcAccessMask = vk::AccessFlagBits::eTransferWrite;
+		clear.dstAccessMask = vk::AccessFlagBits::eShaderRead | vk::AccessFlagBits::eShaderWrite;
+		cmd.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eComputeShader,
+			{}, clear, nullptr, nullptr);
+
+		CullConstants cc {};
+		cc.planes = f.planes;
+		cc.objectCount = m_objectCount;
+		cc.compact = m_context.get_features().drawIndirectCount ? 1u : 0u;
+
+		const vk::DescriptorSet sets[] = { m_set };
+		m_pipeline->bind_cmd(cmd);
+		m_pipeline->bind_sets_cmd(cmd, 0, sets);
+		m_pipeline->push_constants_cmd(cmd, cc);
+		m_pipeline->dispatch_cmd(cmd, ComputePipeline::group_count(m_objectCount, k_CullGroupSize));
+
+		vk::MemoryBarrier done {};
+		done.srcAccessMask = vk::AccessFlagBits::eShaderWrite;
+		done.dstAccessMask = vk::AccessFlagBits::eIndirectCommandRead;
+		cmd.pipelineBarrier(vk::PipelineStageFlagBits::eComputeShader, vk::PipelineStageFlagBits::eDrawIndirect,
+			{}, done, nullptr, nullptr);
+	}
+
+	void GpuCuller::draw_cmd(vk::CommandBuffer cmd) const
+	{
+		m_context.draw_indexed_indirect_count_cmd(cmd, *m_draws, 0, *m_count, 0, m_objectCount);
+	}
+}
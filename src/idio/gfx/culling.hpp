@@ -0,0 +1,66 @@
+/**
+ * Copyright (c) 2022 Connor Mellon
+ * 
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+#ifndef IDIO_GFX_CULLING_H
+#define IDIO_GFX_CULLING_H
+
+namespace idio
+{
+	class Context;
+
+	// Matches CullObject in shaders/cull.comp (std430)
+	struct CullObject
+	{
+		glm::mat4 transform;
+		glm::vec4 sphere; // Object space centre and radius
+		uint32_t indexCount = 0;
+		uint32_t firstIndex = 0;
+		int32_t vertexOffset = 0;
+		uint32_t pad = 0;
+	};
+
+	struct Frustum
+	{
+		std::array<glm::vec4, 6> planes;
+
+		static Frustum from_matrix(const glm::mat4 &viewProj);
+	};
+
+	// Frustum culls a gpu buffer of objects in compute and writes the survivors
+	// as indexed indirect draws. firstInstance of every draw is the object index.
+	class GpuCuller
+	{
+	public:
+		GpuCuller(const Context &c, uint32_t maxObjects, const std::string &shaderPath = "./shaders/cull.comp.spv");
+		~GpuCuller();
+		GpuCuller(const GpuCuller &o) = delete;
+		GpuCuller &operator=(const GpuCuller &o) = delete;
+
+		void upload_objects_cmd(vk::CommandBuffer cmd, StorageBuffer<BufferUse::Staging> &src, uint32_t count);
+		void cull_cmd(vk::CommandBuffer cmd, const Frustum &f);
+		void draw_cmd(vk::CommandBuffer cmd) const;
+
+		StorageBuffer<BufferUse::Gpu> &get_objects() { return *m_objects; }
+		uint32_t get_object_count() const { return m_objectCount; }
+	private:
+		const Context &m_context;
+		uint32_t m_maxObjects;
+		uint32_t m_objectCount = 0;
+
+		std::unique_ptr<StorageBuffer<BufferUse::Gpu>> m_objects;
+		std::unique_ptr<IndirectStorageBuffer> m_draws;
+		std::unique_ptr<IndirectStorageBuffer> m_count;
+
+		vk::DescriptorPool m_pool;
+		vk::DescriptorSetLayout m_layout;
+		vk::DescriptorSet m_set;
+		std::unique_ptr<ComputePipeline> m_pipeline;
+	};
+}
+
+#endif
@@ -0,0 +1,302 @@
+/**
+ * Copyright (c) 2022 Connor Mellon
+ * 
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+#include "pch.hpp"
+#include "device.hpp"
+
+#include <cctype>
+#include <cstdlib>
+#include <charconv>
+
+#include "vkutl.hpp"
+
+namespace
+{
+	std::string to_lower(std::string_view s)
+	{
+		std::string out(s);
+		std::transform(out.begin(), out.end(), out.begin(), [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+		return out;
+	}
+}
+
+namespace idio
+{
+	PhysicalDevice::PhysicalDevice(vk::PhysicalDevice pdev, vk::SurfaceKHR surface) :
+		handle(pdev),
+		props(handle.getProperties())
+	{
+		auto qfprops = handle.getQueueFamilyProperties();
+		for(uint32_t i = 0; i < static_cast<uint32_t>(qfprops.size()); i++) {
+			const auto &qfp = qfprops[i];
+			if(qfp.queueCount == 0) {
+				continue;
+			}
+
+			if(qfp.queueFlags & vk::QueueFlagBits::eGraphics) {
+				// Prefer the first graphics family that can also present
+				const bool present = surface && handle.getSurfaceSupportKHR(i, surface).value;
+				if(gfxQueueFamilyIdx == std::numeric_limits<uint32_t>::max() || (present && !canPresent)) {
+					gfxQueueFamilyIdx = i;
+					canPresent = present;
+				}
+			} else if(qfp.queueFlags & vk::QueueFlagBits::eCompute) {
+				computeQueueFamilyIdx = i; // Dedicated async compute family
+			}
+		}
+
+		if(computeQueueFamilyIdx == std::numeric_limits<uint32_t>::max()) {
+			computeQueueFamilyIdx = gfxQueueFamilyIdx; // Graphics families always support compute
+		}
+
+		const auto mprops = handle.getMemoryProperties();
+		for(uint32_t i = 0; i < mprops.memoryHeapCount; i++) {
+			if(mprops.memoryHeaps[i].flags & vk::MemoryHeapFlagBits::eDeviceLocal) {
+				deviceLocalMemory = std::max(deviceLocalMemory, mprops.memoryHeaps[i].size);
+			}
+		}
+
+		// Feature structures from newer versions can't even be queried on older drivers
+		if(props.apiVersion < VK_API_VERSION_1_2) {
+			return;
+		}
+
+		auto exts = handle.enumerateDeviceExtensionProperties().value;
+		auto has_ext = [&exts](std::string_view name) {
+			return std::any_of(exts.begin(), exts.end(), [name](const vk::ExtensionProperties &e) {
+				return std::string_view(e.extensionName) == name;
+			});
+		};
+
+		auto core = handle.getFeatures2<vk::PhysicalDeviceFeatures2, vk::PhysicalDeviceVulkan12Features>();
+		const auto &f10 = core.get<vk::PhysicalDeviceFeatures2>().features;
+		const auto &f12 = core.get<vk::PhysicalDeviceVulkan12Features>();
+		features.multiDrawIndirect = f10.multiDrawIndirect;
+		features.drawIndirectFirstInstance = f10.drawIndirectFirstInstance;
+		features.samplerAnisotropy = f10.samplerAnisotropy;
+		features.drawIndirectCount = f12.drawIndirectCount;
+		features.timelineSemaphores = f12.timelineSemaphore;
+		features.bufferDeviceAddress = f12.bufferDeviceAddress;
+		features.descriptorIndexing = f12.descriptorIndexing && f12.descriptorBindingPartiallyBound
+			&& f12.descriptorBindingSampledImageUpdateAfterBind && f12.descriptorBindingVariableDescriptorCount
+			&& f12.runtimeDescriptorArray && f12.shaderSampledImageArrayNonUniformIndexing;
+
+		if(props.apiVersion >= VK_API_VERSION_1_3) {
+			auto f13 = handle.getFeatures2<vk::PhysicalDeviceFeatures2, vk::PhysicalDeviceVulkan13Features>()
+				.get<vk::PhysicalDeviceVulkan13Features>();
+			features.synchronization2 = f13.synchronization2;
+			features.dynamicRendering = f13.dynamicRendering;
+			features.extendedDynamicState = true; // Core in 1.3 without a feature bit
+		} else {
+			if(has_ext(VK_KHR_SYNCHRONIZATION_2_EXTENSION_NAME)) {
+				features.synchronization2 = handle.getFeatures2<vk::PhysicalDeviceFeatures2,
+					vk::PhysicalDeviceSynchronization2FeaturesKHR>().get<vk::PhysicalDeviceSynchronization2FeaturesKHR>().synchronization2;
+			}
+
+			if(has_ext(VK_KHR_DYNAMIC_RENDERING_EXTENSION_NAME)) {
+				features.dynamicRendering = handle.getFeatures2<vk::PhysicalDeviceFeatures2,
+					vk::PhysicalDeviceDynamicRenderingFeaturesKHR>().get<vk::PhysicalDeviceDynamicRenderingFeaturesKHR>().dynamicRendering;
+			}
+
+			if(has_ext(VK_EXT_EXTENDED_DYNAMIC_STATE_EXTENSION_NAME)) {
+				features.extendedDynamicState = handle.getFeatures2<vk::PhysicalDeviceFeatures2,
+					vk::PhysicalDeviceExtendedDynamicStateFeaturesEXT>().get<vk::PhysicalDeviceExtendedDynamicStateFeaturesEXT>().extendedDynamicState;
+			}
+		}
+
+		features.memoryBudget = has_ext(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+		if(has_ext(VK_KHR_PRESENT_ID_EXTENSION_NAME) && has_ext(VK_KHR_PRESENT_WAIT_EXTENSION_NAME)) {
+			auto pwfeatures = handle.getFeatures2<vk::PhysicalDeviceFeatures2,
+				vk::PhysicalDevicePresentIdFeaturesKHR, vk::PhysicalDevicePresentWaitFeaturesKHR>();
+			features.presentWait = pwfeatures.get<vk::PhysicalDevicePresentIdFeaturesKHR>().presentId
+				&& pwfeatures.get<vk::PhysicalDevicePresentWaitFeaturesKHR>().presentWait;
+		}
+	}
+
+	bool PhysicalDevice::is_suitable() const noexcept
+	{
+		return gfxQueueFamilyIdx != std::numeric_limits<uint32_t>::max() && canPresent
+			&& props.apiVersion >= VK_API_VERSION_1_2;
+	}
+
+	uint64_t PhysicalDevice::score() const noexcept
+	{
+		uint64_t type = 0;
+		switch(props.deviceType) {
+		case vk::PhysicalDeviceType::eDiscreteGpu:
+			type = 4;
+			break;
+		case vk::PhysicalDeviceType::eIntegratedGpu:
+			type = 3;
+			break;
+		case vk::PhysicalDeviceType::eVirtualGpu:
+			type = 2;
+			break;
+		case vk::PhysicalDeviceType::eCpu:
+			type = 1;
+			break;
+		default:
+			break;
+		}
+
+		const auto &f = features;
+		const auto featureCount = static_cast<uint64_t>(f.timelineSemaphores + f.synchronization2 + f.dynamicRendering
+			+ f.extendedDynamicState + f.descriptorIndexing + f.bufferDeviceAddress + f.drawIndirectCount
+			+ f.multiDrawIndirect + f.drawIndirectFirstInstance + f.samplerAnisotropy + f.memoryBudget + f.presentWait);
+		const uint64_t asyncCompute = computeQueueFamilyIdx != gfxQueueFamilyIdx ? 1 : 0;
+
+		// Each tier outweighs everything below it, memory is counted in MiB
+		return (type << 56) | (std::min<uint64_t>(deviceLocalMemory >> 20, 0xFFFFFFFF) << 16) | (featureCount << 8) | asyncCompute;
+	}
+
+	PhysicalDevice select_physical_device(vk::Instance inst, vk::SurfaceKHR surface)
+	{
+		auto rawpdevs = inst.enumeratePhysicalDevices().value;
+		std::vector<PhysicalDevice> pdevs;
+		pdevs.reserve(rawpdevs.size());
+		for(auto p : rawpdevs) {
+			pdevs.emplace_back(p, surface);
+		}
+
+		for(size_t i = 0; i < pdevs.size(); i++) {
+			const auto &pd = pdevs[i];
+			s_EngineLogger->info("GPU {}: {} ({}, {} MiB){}", i, pd.props.deviceName, vk::to_string(pd.props.deviceType),
+				pd.deviceLocalMemory >> 20, pd.is_suitable() ? "" : " can't render to the window");
+		}
+
+		std::optional<size_t> choice;
+		if(const char *env = std::getenv("IDIO_DEVICE")) {
+			const std::string_view want(env);
+			size_t idx = 0;
+			auto [end, ec] = std::from_chars(want.data(), want.data() + want.size(), idx);
+			if(ec == std::errc {} && end == want.data() + want.size()) {
+				if(idx < pdevs.size()) {
+					choice = idx;
+				}
+			} else {
+				const auto lwant = to_lower(want);
+				auto it = std::find_if(pdevs.begin(), pdevs.end(), [&lwant](const PhysicalDevice &pd) {
+					return to_lower(pd.props.deviceName.data()).find(lwant) != std::string::npos;
+				});
+				if(it != pdevs.end()) {
+					choice = static_cast<size_t>(it - pdevs.begin());
+				}
+			}
+
+			if(!choice) {
+				s_EngineLogger->warn("IDIO_DEVICE={} doesn't match any GPU", want);
+			} else if(!pdevs[*choice].is_suitable()) {
+				s_EngineLogger->warn("IDIO_DEVICE={} can't render to the window, ignoring it", want);
+				choice.reset();
+			}
+		}
+
+		if(!choice) {
+			for(size_t i = 0; i < pdevs.size(); i++) {
+				if(pdevs[i].is_suitable() && (!choice || pdevs[i].score() > pdevs[*choice].score())) {
+					choice = i;
+				}
+			}
+		}
+
+		if(!choice) {
+			s_EngineLogger->critical("No suitable graphics devices found.");
+			Application::crash();
+		}
+
+		return pdevs[*choice];
+	}
+
+	vk::Device create_logical_device(const PhysicalDevice &pdev, std::span<const vk::DeviceQueueCreateInfo> queues,
+		std::span<const char *const> layers)
+	{
+		const auto &f = pdev.features;
+		std::vector<const char *> exts { VK_KHR_SWAPCHAIN_EXTENSION_NAME };
+
+		vk::PhysicalDeviceFeatures2 features {};
+		void **tail = &features.pNext;
+		auto chain = [&tail](auto &s) {
+			*tail = &s;
+			tail = &s.pNext;
+		};
+
+		features.features.multiDrawIndirect = f.multiDrawIndirect;
+		features.features.drawIndirectFirstInstance = f.drawIndirectFirstInstance;
+		features.features.samplerAnisotropy = f.samplerAnisotropy;
+
+		vk::PhysicalDeviceVulkan12Features f12 {};
+		f12.drawIndirectCount = f.drawIndirectCount;
+		f12.timelineSemaphore = f.timelineSemaphores;
+		f12.bufferDeviceAddress = f.bufferDeviceAddress;
+		f12.descriptorIndexing = f.descriptorIndexing;
+		f12.descriptorBindingPartiallyBound = f.descriptorIndexing;
+		f12.descriptorBindingSampledImageUpdateAfterBind = f.descriptorIndexing;
+		f12.descriptorBindingVariableDescriptorCount = f.descriptorIndexing;
+		f12.runtimeDescriptorArray = f.descriptorIndexing;
+		f12.shaderSampledImageArrayNonUniformIndexing = f.descriptorIndexing;
+		chain(f12);
+
+		vk::PhysicalDeviceVulkan13Features f13 {};
+		vk::PhysicalDeviceSynchronization2FeaturesKHR sync2 {};
+		vk::PhysicalDeviceDynamicRenderingFeaturesKHR dynrender {};
+		vk::PhysicalDeviceExtendedDynamicStateFeaturesEXT eds {};
+		if(pdev.props.apiVersion >= VK_API_VERSION_1_3) {
+			f13.synchronization2 = f.synchronization2;
+			f13.dynamicRendering = f.dynamicRendering;
+			chain(f13);
+		} else {
+			if(f.synchronization2) {
+				exts.push_back(VK_KHR_SYNCHRONIZATION_2_EXTENSION_NAME);
+				sync2.synchronization2 = true;
+				chain(sync2);
+			}
+
+			if(f.dynamicRendering) {
+				exts.push_back(VK_KHR_DYNAMIC_RENDERING_EXTENSION_NAME);
+				dynrender.dynamicRendering = true;
+				chain(dynrender);
+			}
+
+			if(f.extendedDynamicState) {
+				exts.push_back(VK_EXT_EXTENDED_DYNAMIC_STATE_EXTENSION_NAME);
+				eds.extendedDynamicState = true;
+				chain(eds);
+			}
+		}
+
+		if(f.memoryBudget) {
+			exts.push_back(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+		}
+
+		vk::PhysicalDevicePresentIdFeaturesKHR presentIdFeatures {};
+		vk::PhysicalDevicePresentWaitFeaturesKHR presentWaitFeatures {};
+		if(f.presentWait) {
+			exts.push_back(VK_KHR_PRESENT_ID_EXTENSION_NAME);
+			exts.push_back(VK_KHR_PRESENT_WAIT_EXTENSION_NAME);
+			presentIdFeatures.presentId = true;
+			presentWaitFeatures.presentWait = true;
+			chain(presentIdFeatures);
+			chain(presentWaitFeatures);
+		}
+
+		s_EngineLogger->info("Optional features: timeline semaphores {}, synchronization2 {}, dynamic rendering {}, "
+			"extended dynamic state {}, descriptor indexing {}, buffer device address {}, present wait {}",
+			f.timelineSemaphores, f.synchronization2, f.dynamicRendering, f.extendedDynamicState,
+			f.descriptorIndexing, f.bufferDeviceAddress, f.presentWait);
+
+		vk::DeviceCreateInfo ci {};
+		ci.pNext = &features;
+		ci.queueCreateInfoCount = static_cast<uint32_t>(queues.size());
+		ci.pQueueCreateInfos = queues.data();
+		ci.enabledLayerCount = static_cast<uint32_t>(layers.size());
+		ci.ppEnabledLayerNames = layers.data();
+		ci.enabledExtensionCount = static_cast<uint32_t>(exts.size());
+		ci.ppEnabledExtensionNames = exts.data();
+		return check_vk(pdev.handle.createDevice(ci), "Failed to create device");
+	}
+}
@@ -0,0 +1,62 @@
+/**
+ * Copyright (c) 2022 Connor Mellon
+ * 
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+#ifndef IDIO_GFX_DEVICE_H
+#define IDIO_GFX_DEVICE_H
+
+namespace idio
+{
+	// Optional features, each is enabled whenever the device supports it.
+	// Check Context::get_features() and take the fallback path when one is missing.
+	struct DeviceFeatures
+	{
+		bool timelineSemaphores = false;
+		bool synchronization2 = false;
+		bool dynamicRendering = false;
+		bool extendedDynamicState = false;
+		// Partially bound, update after bind, variable count and non uniformly indexed sampled image arrays
+		bool descriptorIndexing = false;
+		bool bufferDeviceAddress = false;
+		bool drawIndirectCount = false;
+		bool multiDrawIndirect = false;
+		bool drawIndirectFirstInstance = false;
+		bool samplerAnisotropy = false;
+		bool memoryBudget = false; // VK_EXT_memory_budget
+		bool presentWait = false;  // VK_KHR_present_id and VK_KHR_present_wait
+	};
+
+	struct PhysicalDevice
+	{
+		vk::PhysicalDevice handle = nullptr;
+		vk::PhysicalDeviceProperties props {};
+		DeviceFeatures features {};
+		vk::DeviceSize deviceLocalMemory = 0; // Largest device local heap
+		bool canPresent = false;
+		uint32_t gfxQueueFamilyIdx = std::numeric_limits<uint32_t>::max();
+		uint32_t computeQueueFamilyIdx = std::numeric_limits<uint32_t>::max();
+
+		PhysicalDevice() = default;
+		// Presentation support is checked against surface
+		PhysicalDevice(vk::PhysicalDevice pdev, vk::SurfaceKHR surface);
+
+		// A graphics queue that can present to the surface on a Vulkan 1.2 driver
+		bool is_suitable() const noexcept;
+		// Device type first, then memory, then optional features and async compute
+		uint64_t score() const noexcept;
+	};
+
+	// Picks the highest scoring suitable device. IDIO_DEVICE overrides the choice with
+	// either an index in enumeration order or part of the device's name.
+	PhysicalDevice select_physical_device(vk::Instance inst, vk::SurfaceKHR surface);
+
+	// Enables every feature in pdev.features, plus the swapchain
+	vk::Device create_logical_device(const PhysicalDevice &pdev, std::span<const vk::DeviceQueueCreateInfo> queues,
+		std::span<const char *const> layers);
+}
+
+#endif
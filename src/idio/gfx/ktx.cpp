@@ -0,0 +1,547 @@
+/**
+ * Copyright (c) 2022 Connor Mellon
+ * 
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+#include "pch.hpp"
+#include "buffer.hpp"
+#include "texture.hpp"
+#include "ktx.hpp"
+
+#include <numeric>
+
+#include "vkutl.hpp"
+#include "device.hpp"
+#include "context.hpp"
+#include "core/file.hpp"
+
+namespace idio
+{
+	namespace
+	{
+		constexpr uint8_t k_KtxIdentifier[12] = { 0xAB, 'K', 'T', 'X', ' ', '2', '0', 0xBB, '\r', '\n', 0x1A, '\n' };
+		constexpr size_t k_KtxHeaderSize = 80;
+		constexpr size_t k_KtxLevelEntrySize = 24;
+
+		struct Rgba
+		{
+			uint8_t r = 0, g = 0, b = 0, a = 255;
+		};
+
+		using Block = std::array<Rgba, 16>; // Row major 4x4 texels
+
+		enum class Codec
+		{
+			None,
+			Bc1,
+			Bc1Alpha,
+			Bc3,
+			Bc4,
+			Bc5,
+			Etc2Rgb,
+			Etc2Rgba
+		};
+
+		struct FormatInfo
+		{
+			Codec codec = Codec::None;
+			size_t blockSize = 0;
+			bool srgb = false;
+		};
+
+		FormatInfo get_format_info(vk::Format f)
+		{
+			using F = vk::Format;
+			switch(f) {
+			case F::eBc1RgbUnormBlock: return { Codec::Bc1, 8, false };
+			case F::eBc1RgbSrgbBlock: return { Codec::Bc1, 8, true };
+			case F::eBc1RgbaUnormBlock: return { Codec::Bc1Alpha, 8, false };
+			case F::eBc1RgbaSrgbBlock: return { Codec::Bc1Alpha, 8, true };
+			case F::eBc3UnormBlock: return { Codec::Bc3, 16, false };
+			case F::eBc3SrgbBlock: return { Codec::Bc3, 16, true };
+			case F::eBc4UnormBlock: return { Codec::Bc4, 8, false };
+			case F::eBc5UnormBlock: return { Codec::Bc5, 16, false };
+			case F::eEtc2R8G8B8UnormBlock: return { Codec::Etc2Rgb, 8, false };
+			case F::eEtc2R8G8B8SrgbBlock: return { Codec::Etc2Rgb, 8, true };
+			case F::eEtc2R8G8B8A8UnormBlock: return { Codec::Etc2Rgba, 16, false };
+			case F::eEtc2R8G8B8A8SrgbBlock: return { Codec::Etc2Rgba, 16, true };
+			default: return {};
+			}
+		}
+
+		struct BlockLayout
+		{
+			uint32_t width = 1, height = 1;
+			uint32_t bytes = 0; // 0 when the format isn't known
+		};
+
+		// Texel block dimensions of the formats KTX2 files are realistically made with
+		BlockLayout get_block_layout(vk::Format f)
+		{
+			using F = vk::Format;
+			switch(f) {
+			case F::eR8Unorm: case F::eR8Snorm: case F::eR8Uint: case F::eR8Sint: case F::eR8Srgb:
+				return { 1, 1, 1 };
+			case F::eR8G8Unorm: case F::eR8G8Snorm: case F::eR8G8Uint: case F::eR8G8Sint: case F::eR8G8Srgb:
+			case F::eR16Unorm: case F::eR16Snorm: case F::eR16Uint: case F::eR16Sint: case F::eR16Sfloat:
+			case F::eR5G6B5UnormPack16: case F::eB5G6R5UnormPack16: case F::eR4G4B4A4UnormPack16:
+			case F::eB4G4R4A4UnormPack16: case F::eR5G5B5A1UnormPack16: case F::eB5G5R5A1UnormPack16:
+			case F::eA1R5G5B5UnormPack16:
+				return { 1, 1, 2 };
+			case F::eR8G8B8Unorm: case F::eR8G8B8Srgb: case F::eB8G8R8Unorm: case F::eB8G8R8Srgb:
+				return { 1, 1, 3 };
+			case F::eR8G8B8A8Unorm: case F::eR8G8B8A8Snorm: case F::eR8G8B8A8Uint: case F::eR8G8B8A8Sint:
+			case F::eR8G8B8A8Srgb: case F::eB8G8R8A8Unorm: case F::eB8G8R8A8Srgb: case F::eA8B8G8R8UnormPack32:
+			case F::eA8B8G8R8SrgbPack32: case F::eA2R10G10B10UnormPack32: case F::eA2B10G10R10UnormPack32:
+			case F::eB10G11R11UfloatPack32: case F::eE5B9G9R9UfloatPack32: case F::eR16G16Unorm:
+			case F::eR16G16Snorm: case F::eR16G16Uint: case F::eR16G16Sint: case F::eR16G16Sfloat:
+			case F::eR32Uint: case F::eR32Sint: case F::eR32Sfloat:
+				return { 1, 1, 4 };
+			case F::eR16G16B16A16Unorm: case F::eR16G16B16A16Snorm: case F::eR16G16B16A16Uint:
+			case F::eR16G16B16A16Sint: case F::eR16G16B16A16Sfloat: case F::eR32G32Uint: case F::eR32G32Sint:
+			case F::eR32G32Sfloat:
+				return { 1, 1, 8 };
+			case F::eR32G32B32Uint: case F::eR32G32B32Sint: case F::eR32G32B32Sfloat:
+				return { 1, 1, 12 };
+			case F::eR32G32B32A32Uint: case F::eR32G32B32A32Sint: case F::eR32G32B32A32Sfloat:
+				return { 1, 1, 16 };
+			case F::eBc1RgbUnormBlock: case F::eBc1RgbSrgbBlock: case F::eBc1RgbaUnormBlock: case F::eBc1RgbaSrgbBlock:
+			case F::eBc4UnormBlock: case F::eBc4SnormBlock: case F::eEtc2R8G8B8UnormBlock: case F::eEtc2R8G8B8SrgbBlock:
+			case F::eEtc2R8G8B8A1UnormBlock: case F::eEtc2R8G8B8A1SrgbBlock: case F::eEacR11UnormBlock:
+			case F::eEacR11SnormBlock:
+				return { 4, 4, 8 };
+			case F::eBc2UnormBlock: case F::eBc2SrgbBlock: case F::eBc3UnormBlock: case F::eBc3SrgbBlock:
+			case F::eBc5UnormBlock: case F::eBc5SnormBlock: case F::eBc6HUfloatBlock: case F::eBc6HSfloatBlock:
+			case F::eBc7UnormBlock: case F::eBc7SrgbBlock: case F::eEtc2R8G8B8A8UnormBlock:
+			case F::eEtc2R8G8B8A8SrgbBlock: case F::eEacR11G11UnormBlock: case F::eEacR11G11SnormBlock:
+			case F::eAstc4x4UnormBlock: case F::eAstc4x4SrgbBlock:
+				return { 4, 4, 16 };
+			case F::eAstc5x4UnormBlock: case F::eAstc5x4SrgbBlock: return { 5, 4, 16 };
+			case F::eAstc5x5UnormBlock: case F::eAstc5x5SrgbBlock: return { 5, 5, 16 };
+			case F::eAstc6x5UnormBlock: case F::eAstc6x5SrgbBlock: return { 6, 5, 16 };
+			case F::eAstc6x6UnormBlock: case F::eAstc6x6SrgbBlock: return { 6, 6, 16 };
+			case F::eAstc8x5UnormBlock: case F::eAstc8x5SrgbBlock: return { 8, 5, 16 };
+			case F::eAstc8x6UnormBlock: case F::eAstc8x6SrgbBlock: return { 8, 6, 16 };
+			case F::eAstc8x8UnormBlock: case F::eAstc8x8SrgbBlock: return { 8, 8, 16 };
+			case F::eAstc10x5UnormBlock: case F::eAstc10x5SrgbBlock: return { 10, 5, 16 };
+			case F::eAstc10x6UnormBlock: case F::eAstc10x6SrgbBlock: return { 10, 6, 16 };
+			case F::eAstc10x8UnormBlock: case F::eAstc10x8SrgbBlock: return { 10, 8, 16 };
+			case F::eAstc10x10UnormBlock: case F::eAstc10x10SrgbBlock: return { 10, 10, 16 };
+			case F::eAstc12x10UnormBlock: case F::eAstc12x10SrgbBlock: return { 12, 10, 16 };
+			case F::eAstc12x12UnormBlock: case F::eAstc12x12SrgbBlock: return { 12, 12, 16 };
+			default: return {};
+			}
+		}
+
+		template<typename T>
+		T read_le(const std::byte *p)
+		{
+			T v;
+			std::memcpy(&v, p, sizeof(T)); // KTX2 is little endian, as is everything idio runs on
+			return v;
+		}
+
+		uint64_t read_be64(const std::byte *p)
+		{
+			uint64_t v = 0;
+			for(int i = 0; i < 8; i++) {
+				v = (v << 8) | static_cast<uint8_t>(p[i]);
+			}
+			return v;
+		}
+
+		uint8_t clamp8(int v)
+		{
+			return static_cast<uint8_t>(std::clamp(v, 0, 255));
+		}
+
+		Rgba unpack565(uint16_t c)
+		{
+			const int r = (c >> 11) & 31;
+			const int g = (c >> 5) & 63;
+			const int b = c & 31;
+			return { static_cast<uint8_t>((r << 3) | (r >> 2)), static_cast<uint8_t>((g << 2) | (g >> 4)),
+				static_cast<uint8_t>((b << 3) | (b >> 2)), 255 };
+		}
+
+		Rgba mix(Rgba a, Rgba b, int wa, int wb)
+		{
+			const int d = wa + wb;
+			return { static_cast<uint8_t>((a.r * wa + b.r * wb) / d), static_cast<uint8_t>((a.g * wa + b.g * wb) / d),
+				static_cast<uint8_t>((a.b * wa + b.b * wb) / d), 255 };
+		}
+
+		void decode_bc1(const std::byte *src, Block &out, bool punchThrough, bool alpha)
+		{
+			const auto c0 = read_le<uint16_t>(src);
+			const auto c1 = read_le<uint16_t>(src + 2);
+			const auto indices = read_le<uint32_t>(src + 4);
+
+			Rgba pal[4] = { unpack565(c0), unpack565(c1) };
+			if(c0 > c1 || !punchThrough) {
+				pal[2] = mix(pal[0], pal[1], 2, 1);
+				pal[3] = mix(pal[0], pal[1], 1, 2);
+			} else {
+				pal[2] = mix(pal[0], pal[1], 1, 1);
+				pal[3] = { 0, 0, 0, static_cast<uint8_t>(alpha ? 0 : 255) };
+			}
+
+			for(int i = 0; i < 16; i++) {
+				out[i] = pal[(indices >> (i * 2)) & 3];
+			}
+		}
+
+		// BC4 style 8 value ramp, shared by BC3 alpha and BC4/BC5 channels
+		void decode_bc4(const std::byte *src, std::array<uint8_t, 16> &out)
+		{
+			const int a0 = static_cast<uint8_t>(src[0]);
+			const int a1 = static_cast<uint8_t>(src[1]);
+			uint64_t indices = 0;
+			for(int i = 0; i < 6; i++) {
+				indices |= static_cast<uint64_t>(static_cast<uint8_t>(src[2 + i])) << (i * 8);
+			}
+
+			int pal[8] = { a0, a1 };
+			if(a0 > a1) {
+				for(int i = 1; i < 7; i++) {
+					pal[i + 1] = ((7 - i) * a0 + i * a1) / 7;
+				}
+			} else {
+				for(int i = 1; i < 5; i++) {
+					pal[i + 1] = ((5 - i) * a0 + i * a1) / 5;
+				}
+				pal[6] = 0;
+				pal[7] = 255;
+			}
+
+			for(int i = 0; i < 16; i++) {
+				out[i] = static_cast<uint8_t>(pal[(indices >> (i * 3)) & 7]);
+			}
+		}
+
+		constexpr int k_EtcModifiers[8][4] = {
+			{ 2, 8, -2, -8 }, { 5, 17, -5, -17 }, { 9, 29, -9, -29 }, { 13, 42, -13, -42 },
+			{ 18, 60, -18, -60 }, { 24, 80, -24, -80 }, { 33, 106, -33, -106 }, { 47, 183, -47, -183 }
+		};
+
+		constexpr int k_EtcDistances[8] = { 3, 6, 11, 16, 23, 32, 41, 64 };
+
+		constexpr int k_EacModifiers[16][8] = {
+			{ -3, -6, -9, -15, 2, 5, 8, 14 }, { -3, -7, -10, -13, 2, 6, 9, 12 },
+			{ -2, -5, -8, -13, 1, 4, 7, 12 }, { -2, -4, -6, -13, 1, 3, 5, 12 },
+			{ -3, -6, -8, -12, 2, 5, 7, 11 }, { -3, -7, -9, -11, 2, 6, 8, 10 },
+			{ -4, -7, -8, -11, 3, 6, 7, 10 }, { -3, -5, -8, -11, 2, 4, 7, 10 },
+			{ -2, -6, -8, -10, 1, 5, 7, 9 }, { -2, -5, -8, -10, 1, 4, 7, 9 },
+			{ -2, -4, -8, -10, 1, 3, 7, 9 }, { -2, -5, -7, -10, 1, 4, 6, 9 },
+			{ -3, -4, -7, -10, 2, 3, 6, 9 }, { -1, -2, -3, -10, 0, 1, 2, 9 },
+			{ -4, -6, -8, -9, 3, 5, 7, 8 }, { -3, -5, -7, -9, 2, 4, 6, 8 }
+		};
+
+		int bits(uint64_t v, int hi, int lo)
+		{
+			return static_cast<int>((v >> lo) & ((uint64_t(1) << (hi - lo + 1)) - 1));
+		}
+
+		int extend4(int v) { return v * 17; }
+		int extend5(int v) { return (v << 3) | (v >> 2); }
+		int extend6(int v) { return (v << 2) | (v >> 4); }
+		int extend7(int v) { return (v << 1) | (v >> 6); }
+
+		Rgba offset_rgb(int r, int g, int b, int d)
+		{
+			return { clamp8(r + d), clamp8(g + d), clamp8(b + d), 255 };
+		}
+
+		// ETC2 RGB8 block; texel indices are column major in the bitstream
+		void decode_etc2_rgb(const std::byte *src, Block &out)
+		{
+			const uint64_t v = read_be64(src);
+			const auto texel_index = [v](int i) { return (bits(v, 16 + i, 16 + i) << 1) | bits(v, i, i); };
+
+			int r[2], g[2], b[2];
+			const bool diff = bits(v, 33, 33) != 0;
+			if(diff) {
+				const int r0 = bits(v, 63, 59), g0 = bits(v, 55, 51), b0 = bits(v, 47, 43);
+				const auto sext3 = [](int x) { return x >= 4 ? x - 8 : x; };
+				const int r1 = r0 + sext3(bits(v, 58, 56));
+				const int g1 = g0 + sext3(bits(v, 50, 48));
+				const int b1 = b0 + sext3(bits(v, 42, 40));
+
+				if(r1 < 0 || r1 > 31) {
+					// T mode
+					const int ra = extend4((bits(v, 60, 59) << 2) | bits(v, 57, 56));
+					const int ga = extend4(bits(v, 55, 52)), ba = extend4(bits(v, 51, 48));
+					const int rb = extend4(bits(v, 47, 44)), gb = extend4(bits(v, 43, 40)), bb = extend4(bits(v, 39, 36));
+					const int d = k_EtcDistances[(bits(v, 35, 34) << 1) | bits(v, 32, 32)];
+					const Rgba paint[4] = { offset_rgb(ra, ga, ba, 0), offset_rgb(rb, gb, bb, d),
+						offset_rgb(rb, gb, bb, 0), offset_rgb(rb, gb, bb, -d) };
+					for(int i = 0; i < 16; i++) {
+						out[(i & 3) * 4 + (i >> 2)] = paint[texel_index(i)];
+					}
+					return;
+				}
+
+				if(g1 < 0 || g1 > 31) {
+					// H mode
+					const int ra = extend4(bits(v, 62, 59));
+					const int ga = extend4((bits(v, 58, 56) << 1) | bits(v, 52, 52));
+					const int ba = extend4((bits(v, 51, 51) << 3) | bits(v, 49, 47));
+					const int rb = extend4(bits(v, 46, 43)), gb = extend4(bits(v, 42, 39)), bb = extend4(bits(v, 38, 35));
+					const int order = ((ra << 16) | (ga << 8) | ba) >= ((rb << 16) | (gb << 8) | bb) ? 1 : 0;
+					const int d = k_EtcDistances[(bits(v, 34, 34) << 2) | (bits(v, 32, 32) << 1) | order];
+					const Rgba paint[4] = { offset_rgb(ra, ga, ba, d), offset_rgb(ra, ga, ba, -d),
+						offset_rgb(rb, gb, bb, d), offset_rgb(rb, gb, bb, -d) };
+					for(int i = 0; i < 16; i++) {
+						out[(i & 3) * 4 + (i >> 2)] = paint[texel_index(i)];
+					}
+					return;
+				}
+
+				if(b1 < 0 || b1 > 31) {
+					// Planar mode, a gradient across the block
+					const int ro = extend6(bits(v, 62, 57));
+					const int go = extend7((bits(v, 56, 56) << 6) | bits(v, 54, 49));
+					const int bo = extend6((bits(v, 48, 48) << 5) | (bits(v, 44, 43) << 3) | bits(v, 41, 39));
+					const int rh = extend6((bits(v, 38, 34) << 1) | bits(v, 32, 32));
+					const int gh = extend7(bits(v, 31, 25)), bh = extend6(bits(v, 24, 19));
+					const int rv = extend6(bits(v, 18, 13)), gv = extend7(bits(v, 12, 6)), bv = extend6(bits(v, 5, 0));
+					for(int y = 0; y < 4; y++) {
+						for(int x = 0; x < 4; x++) {
+							out[y * 4 + x] = {
+								clamp8((x * (rh - ro) + y * (rv - ro) + 4 * ro + 2) >> 2),
+								clamp8((x * (gh - go) + y * (gv - go) + 4 * go + 2) >> 2),
+								clamp8((x * (bh - bo) + y * (bv - bo) + 4 * bo + 2) >> 2),
+								255
+							};
+						}
+					}
+					return;
+				}
+
+				r[0] = extend5(r0); g[0] = extend5(g0); b[0] = extend5(b0);
+				r[1] = extend5(r1); g[1] = extend5(g1); b[1] = extend5(b1);
+			} else {
+				r[0] = extend4(bits(v, 63, 60)); r[1] = extend4(bits(v, 59, 56));
+				g[0] = extend4(bits(v, 55, 52)); g[1] = extend4(bits(v, 51, 48));
+				b[0] = extend4(bits(v, 47, 44)); b[1] = extend4(bits(v, 43, 40));
+			}
+
+			// Individual and differential modes: two sub blocks, each with a base colour and modifier table
+			const int tables[2] = { bits(v, 39, 37), bits(v, 36, 34) };
+			const bool flip = bits(v, 32, 32) != 0;
+			for(int i = 0; i < 16; i++) {
+				const int x = i >> 2, y = i & 3;
+				const int sub = flip ? (y >= 2) : (x >= 2);
+				const int d = k_EtcModifiers[tables[sub]][texel_index(i)];
+				out[y * 4 + x] = offset_rgb(r[sub], g[sub], b[sub], d);
+			}
+		}
+
+		void decode_eac_alpha(const std::byte *src, Block &out)
+		{
+			const uint64_t v = read_be64(src);
+			const int base = bits(v, 63, 56);
+			const int mul = bits(v, 55, 52);
+			const auto &mods = k_EacModifiers[bits(v, 51, 48)];
+			for(int i = 0; i < 16; i++) {
+				const int idx = bits(v, 47 - i * 3, 45 - i * 3);
+				out[(i & 3) * 4 + (i >> 2)].a = clamp8(base + mods[idx] * mul);
+			}
+		}
+
+		void decode_block(Codec codec, const std::byte *src, Block &out)
+		{
+			std::array<uint8_t, 16> ch0, ch1;
+			switch(codec) {
+			case Codec::Bc1:
+				decode_bc1(src, out, true, false);
+				break;
+			case Codec::Bc1Alpha:
+				decode_bc1(src, out, true, true);
+				break;
+			case Codec::Bc3:
+				decode_bc1(src + 8, out, false, false);
+				decode_bc4(src, ch0);
+				for(int i = 0; i < 16; i++) {
+					out[i].a = ch0[i];
+				}
+				break;
+			case Codec::Bc4:
+				decode_bc4(src, ch0);
+				for(int i = 0; i < 16; i++) {
+					out[i] = { ch0[i], 0, 0, 255 };
+				}
+				break;
+			case Codec::Bc5:
+				decode_bc4(src, ch0);
+				decode_bc4(src + 8, ch1);
+				for(int i = 0; i < 16; i++) {
+					out[i] = { ch0[i], ch1[i], 0, 255 };
+				}
+				break;
+			case Codec::Etc2Rgb:
+				decode_etc2_rgb(src, out);
+				break;
+			case Codec::Etc2Rgba:
+				decode_etc2_rgb(src + 8, out);
+				decode_eac_alpha(src, out);
+				break;
+			case Codec::None:
+				break;
+			}
+		}
+
+		// Expands one level to tightly packed RGBA8 at dst
+		void decode_level(const FormatInfo &fi, const KtxLevel &level, uint8_t *dst)
+		{
+			const uint32_t bw = (level.extent.width + 3) / 4;
+			const uint32_t bh = (level.extent.height + 3) / 4;
+			const auto *src = level.data.data();
+			Block block;
+			for(uint32_t by = 0; by < bh; by++) {
+				for(uint32_t bx = 0; bx < bw; bx++, src += fi.blockSize) {
+					decode_block(fi.codec, src, block);
+					for(uint32_t y = 0; y < 4 && by * 4 + y < level.extent.height; y++) {
+						for(uint32_t x = 0; x < 4 && bx * 4 + x < level.extent.width; x++) {
+							const size_t texel = (by * 4 + y) * level.extent.width + bx * 4 + x;
+							std::memcpy(dst + texel * 4, &block[y * 4 + x], 4);
+						}
+					}
+				}
+			}
+		}
+	}
+
+	std::optional<KtxImage> parse_ktx2(std::span<const std::byte> data)
+	{
+		if(data.size() < k_KtxHeaderSize || std::memcmp(data.data(), k_KtxIdentifier, sizeof(k_KtxIdentifier)) != 0) {
+			s_EngineLogger->warn("Not a KTX2 file");
+			return {};
+		}
+
+		const auto *hdr = data.data() + sizeof(k_KtxIdentifier);
+		const auto format = read_le<uint32_t>(hdr);
+		const auto width = read_le<uint32_t>(hdr + 8);
+		const auto height = read_le<uint32_t>(hdr + 12);
+		const auto depth = read_le<uint32_t>(hdr + 16);
+		const auto layers = read_le<uint32_t>(hdr + 20);
+		const auto faces = read_le<uint32_t>(hdr + 24);
+		const auto levels = std::max(read_le<uint32_t>(hdr + 28), 1u);
+		const auto supercompression = read_le<uint32_t>(hdr + 32);
+
+		if(format == VK_FORMAT_UNDEFINED || supercompression != 0) {
+			s_EngineLogger->warn("Basis and supercompressed KTX2 files aren't supported");
+			return {};
+		}
+
+		if(depth > 1 || layers > 1 || faces != 1 || height == 0) {
+			s_EngineLogger->warn("Only single layer 2D KTX2 textures are supported");
+			return {};
+		}
+
+		KtxImage img {};
+		img.format = static_cast<vk::Format>(format);
+		img.extent = vk::Extent2D { width, height };
+		img.levelCount = std::min<uint32_t>(levels, static_cast<uint32_t>(img.levels.size()));
+		if(data.size() < k_KtxHeaderSize + k_KtxLevelEntrySize * levels) {
+			s_EngineLogger->warn("Truncated KTX2 level index");
+			return {};
+		}
+
+		for(uint32_t i = 0; i < img.levelCount; i++) {
+			const auto *entry = data.data() + k_KtxHeaderSize + k_KtxLevelEntrySize * i;
+			const auto offset = read_le<uint64_t>(entry);
+			const auto length = read_le<uint64_t>(entry + 8);
+			if(offset > data.size() || length > data.size() - offset) {
+				s_EngineLogger->warn("KTX2 level {} is out of bounds", i);
+				return {};
+			}
+
+			img.levels[i].data = data.subspan(static_cast<size_t>(offset), static_cast<size_t>(length));
+			img.levels[i].extent = vk::Extent2D { std::max(width >> i, 1u), std::max(height >> i, 1u) };
+		}
+
+		return img;
+	}
+
+	std::optional<TextureUpload> load_ktx2_cmd(const Context &c, vk::CommandBuffer cmd, const std::string &pth)
+	{
+		MappedFile file(pth);
+		if(!file.is_open()) {
+			return {};
+		}
+
+		auto img = parse_ktx2(file.get_data());
+		if(!img) {
+			s_EngineLogger->warn("Failed to load {}", pth);
+			return {};
+		}
+
+		const auto fprops = c.get_physdev().handle.getFormatProperties(img->format);
+		const bool supported = static_cast<bool>(fprops.optimalTilingFeatures & vk::FormatFeatureFlagBits::eSampledImage);
+		const auto fi = get_format_info(img->format);
+		if(!supported && fi.codec == Codec::None) {
+			s_EngineLogger->warn("{} uses {}, which the device can't sample", pth, vk::to_string(img->format));
+			return {};
+		}
+
+		// The copies read whole levels, so a level shorter than its extent would read past the staged data
+		const auto layout = get_block_layout(img->format);
+		if(layout.bytes == 0) {
+			s_EngineLogger->warn("{} uses {}, whose block size isn't known", pth, vk::to_string(img->format));
+			return {};
+		}
+
+		for(uint32_t i = 0; i < img->levelCount; i++) {
+			const auto &level = img->levels[i];
+			const size_t blocks = size_t((level.extent.width + layout.width - 1) / layout.width)
+				* ((level.extent.height + layout.height - 1) / layout.height);
+			if(level.data.size() < blocks * layout.bytes) {
+				s_EngineLogger->warn("KTX2 level {} of {} is truncated ({} < {} bytes)", i, pth, level.data.size(), blocks * layout.bytes);
+				return {};
+			}
+		}
+
+		// Offsets must be a multiple of both 4 and the texel block size, which is 3 or 12 bytes for some formats
+		const vk::DeviceSize alignment = std::lcm<vk::DeviceSize>(16, layout.bytes);
+		std::array<vk::DeviceSize, 16> offsets {};
+		vk::DeviceSize total = 0;
+		for(uint32_t i = 0; i < img->levelCount; i++) {
+			const auto &level = img->levels[i];
+			offsets[i] = total;
+			const vk::DeviceSize sz = supported ? level.data.size() : vk::DeviceSize(level.extent.width) * level.extent.height * 4;
+			total = (total + sz + alignment - 1) / alignment * alignment;
+		}
+
+		TextureUpload up;
+		up.staging = std::make_unique<TransferBuffer>(c, total);
+
+		TextureCreateInfo tci {};
+		tci.extent = img->extent;
+		tci.mipLevels = img->levelCount;
+		tci.generateMips = false;
+		if(supported) {
+			tci.format = img->format;
+			for(uint32_t i = 0; i < img->levelCount; i++) {
+				up.staging->write(img->levels[i].data.data(), img->levels[i].data.size(), offsets[i]);
+			}
+		} else {
+			s_EngineLogger->info("{} isn't supported for sampling, decoding {} on the cpu", vk::to_string(img->format), pth);
+			tci.format = fi.srgb ? vk::Format::eR8G8B8A8Srgb : vk::Format::eR8G8B8A8Unorm;
+			std::vector<uint8_t> texels;
+			for(uint32_t i = 0; i < img->levelCount; i++) {
+				const auto &level = img->levels[i];
+				texels.resize(size_t(level.extent.width) * level.extent.height * 4);
+				decode_level(fi, level, texels.data());
+				up.staging->write(texels.data(), texels.size(), offsets[i]);
+			}
+		}
+
+		up.texture = std::make_unique<Texture>(c, tci);
+		up.texture->upload_levels_cmd(cmd, *up.staging, std::span(offsets.data(), img->levelCount));
+		return up;
+	}
+}
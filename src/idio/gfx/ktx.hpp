@@ -0,0 +1,46 @@
+/**
+ * Copyright (c) 2022 Connor Mellon
+ * 
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+#ifndef IDIO_GFX_KTX_H
+#define IDIO_GFX_KTX_H
+
+namespace idio
+{
+	class Context;
+
+	struct KtxLevel
+	{
+		std::span<const std::byte> data;
+		vk::Extent2D extent;
+	};
+
+	// View into a KTX2 file's level data, only valid while the file stays mapped.
+	// Supercompressed, array, cubemap and 3D textures aren't supported.
+	struct KtxImage
+	{
+		vk::Format format = vk::Format::eUndefined;
+		vk::Extent2D extent;
+		uint32_t levelCount = 0;
+		std::array<KtxLevel, 16> levels;
+	};
+
+	std::optional<KtxImage> parse_ktx2(std::span<const std::byte> data);
+
+	struct TextureUpload
+	{
+		std::unique_ptr<Texture> texture;
+		std::unique_ptr<TransferBuffer> staging; // Must outlive the recorded commands
+	};
+
+	// Records the upload of a KTX2 file's whole mip chain. Levels are copied straight from the
+	// mapped file into staging memory; block compressed formats the device can't sample are
+	// decoded to RGBA8 on the cpu instead.
+	std::optional<TextureUpload> load_ktx2_cmd(const Context &c, vk::CommandBuffer cmd, const std::string &pth);
+}
+
+#endif
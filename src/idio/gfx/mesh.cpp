@@ -0,0 +1,150 @@
+/**
+ * Copyright (c) 2022 Connor Mellon
+ * 
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+#include "pch.hpp"
+#include "buffer.hpp"
+#include "pipeline.hpp"
+#include "meshfmt.hpp"
+#include "mesh.hpp"
+
+#include "vkutl.hpp"
+#include "device.hpp"
+#include "context.hpp"
+#include "core/file.hpp"
+
+namespace idio
+{
+	std::optional<MeshView> parse_mesh(std::span<const std::byte> data)
+	{
+		if(data.size() < sizeof(MeshFileHeader)) {
+			s_EngineLogger->warn("Mesh file is too small");
+			return {};
+		}
+
+		// Mapped files are page aligned, so the header can be read in place
+		const auto *hdr = reinterpret_cast<const MeshFileHeader *>(data.data());
+		if(hdr->magic != k_MeshMagic || hdr->version != k_MeshVersion) {
+			s_EngineLogger->warn("Not a version {} mesh file", k_MeshVersion);
+			return {};
+		}
+
+		// Empty meshes would need zero sized buffers, which Vulkan doesn't allow
+		const bool knownFormat = hdr->vertexFormat == MeshVertexFormat::Float || hdr->vertexFormat == MeshVertexFormat::Packed;
+		const auto stride = hdr->vertexFormat == MeshVertexFormat::Packed ? sizeof(MeshVertexPacked) : sizeof(MeshVertex);
+		if(!knownFormat || (hdr->indexSize != 2 && hdr->indexSize != 4) || hdr->vertexStride != stride
+			|| hdr->vertexCount == 0 || hdr->indexCount == 0 || hdr->lodCount == 0 || hdr->lodCount > k_MeshMaxLods) {
+			s_EngineLogger->warn("Unsupported mesh layout");
+			return {};
+		}
+
+		const uint64_t vsz = uint64_t(hdr->vertexCount) * hdr->vertexStride;
+		const uint64_t isz = uint64_t(hdr->indexCount) * hdr->indexSize;
+		if(hdr->vertexOffset > data.size() || vsz > data.size() - hdr->vertexOffset
+			|| hdr->indexOffset > data.size() || isz > data.size() - hdr->indexOffset) {
+			s_EngineLogger->warn("Mesh data is out of bounds");
+			return {};
+		}
+
+		for(uint32_t i = 0; i < hdr->lodCount; i++) {
+			if(uint64_t(hdr->lods[i].firstIndex) + hdr->lods[i].indexCount > hdr->indexCount) {
+				s_EngineLogger->warn("Mesh lod {} is out of bounds", i);
+				return {};
+			}
+		}
+
+		MeshView view {};
+		view.header = hdr;
+		view.vertices = data.subspan(static_cast<size_t>(hdr->vertexOffset), static_cast<size_t>(vsz));
+		view.indices = data.subspan(static_cast<size_t>(hdr->indexOffset), static_cast<size_t>(isz));
+		return view;
+	}
+
+	std::vector<AttributeDescription> get_mesh_attributes(MeshVertexFormat format, uint32_t binding)
+	{
+		const auto attr = [binding](size_t offset, uint32_t location, AttribFormat f) {
+			return AttributeDescription { static_cast<uint32_t>(offset), binding, location, f };
+		};
+
+		if(format == MeshVertexFormat::Packed) {
+			return {
+				attr(offsetof(MeshVertexPacked, pos), 0, AttribFormat::Half4),
+				attr(offsetof(MeshVertexPacked, normal), 1, AttribFormat::Int1010102Snorm),
+				attr(offsetof(MeshVertexPacked, uv), 2, AttribFormat::Half2)
+			};
+		}
+
+		return {
+			attr(offsetof(MeshVertex, pos), 0, AttribFormat::Vec3),
+			attr(offsetof(MeshVertex, normal), 1, AttribFormat::Vec3),
+			attr(offsetof(MeshVertex, uv), 2, AttribFormat::Vec2)
+		};
+	}
+
+	void Mesh::bind_cmd(vk::CommandBuffer cmd) const
+	{
+		const vk::DeviceSize offsets[] = { 0 };
+		VertexBuffer<BufferUse::Gpu>::bind(cmd, std::span(&vertices, 1), offsets);
+		IndexBuffer<BufferUse::Gpu>::bind(cmd, std::span(&indices, 1), offsets);
+	}
+
+	void Mesh::draw_cmd(const Context &c, vk::CommandBuffer cmd, uint32_t lod, uint32_t instanceCount) const
+	{
+		const auto &l = lods[std::min(lod, lodCount - 1)];
+		c.draw_indexed_cmd(cmd, l.indexCount, instanceCount, l.firstIndex);
+	}
+
+	uint32_t Mesh::select_lod(float maxError) const noexcept
+	{
+		uint32_t lod = 0;
+		while(lod + 1 < lodCount && lods[lod + 1].error <= maxError) {
+			lod++;
+		}
+
+		return lod;
+	}
+
+	std::optional<MeshUpload> load_mesh_cmd(const Context &c, vk::CommandBuffer cmd, const std::string &pth)
+	{
+		MappedFile file(pth);
+		if(!file.is_open()) {
+			return {};
+		}
+
+		auto view = parse_mesh(file.get_data());
+		if(!view) {
+			s_EngineLogger->warn("Failed to load {}", pth);
+			return {};
+		}
+
+		const auto *hdr = view->header;
+		MeshUpload up;
+		up.vertexStaging = std::make_unique<VertexBuffer<BufferUse::Staging>>(c, view->vertices.size());
+		const auto indexType = hdr->indexSize == 2 ? vk::IndexType::eUint16 : vk::IndexType::eUint32;
+		up.indexStaging = std::make_unique<IndexBuffer<BufferUse::Staging>>(c, view->indices.size(), indexType);
+		up.vertexStaging->write(view->vertices.data(), view->vertices.size(), 0);
+		up.indexStaging->write(view->indices.data(), view->indices.size(), 0);
+
+		auto &m = up.mesh;
+		m.vertices = std::make_shared<VertexBuffer<BufferUse::Gpu>>(c, view->vertices.size());
+		m.indices = std::make_shared<IndexBuffer<BufferUse::Gpu>>(c, view->indices.size(), indexType);
+		m.vertices->copy_from(cmd, *up.vertexStaging, view->vertices.size(), 0, 0);
+		m.indices->copy_from(cmd, *up.indexStaging, view->indices.size(), 0, 0);
+
+		vk::MemoryBarrier mb {};
+		mb.srcAccessMask = vk::AccessFlagBits::eTransferWrite;
+		mb.dstAccessMask = vk::AccessFlagBits::eVertexAttributeRead | vk::AccessFlagBits::eIndexRead;
+		cmd.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eVertexInput,
+			{}, mb, nullptr, nullptr);
+
+		m.vertexFormat = hdr->vertexFormat;
+		m.lodCount = hdr->lodCount;
+		std::copy_n(hdr->lods, hdr->lodCount, m.lods.begin());
+		m.sphere = glm::vec4(hdr->sphere[0], hdr->sphere[1], hdr->sphere[2], hdr->sphere[3]);
+		return up;
+	}
+}
@@ -0,0 +1,57 @@
+/**
+ * Copyright (c) 2022 Connor Mellon
+ * 
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+#ifndef IDIO_GFX_MESH_H
+#define IDIO_GFX_MESH_H
+
+namespace idio
+{
+	class Context;
+
+	// Views into a cooked mesh, only valid while the backing memory is
+	struct MeshView
+	{
+		const MeshFileHeader *header = nullptr;
+		std::span<const std::byte> vertices;
+		std::span<const std::byte> indices;
+	};
+
+	std::optional<MeshView> parse_mesh(std::span<const std::byte> data);
+	// Vertex input layout for a cooked mesh, locations 0-2 are position, normal and uv
+	std::vector<AttributeDescription> get_mesh_attributes(MeshVertexFormat format, uint32_t binding = 0);
+
+	// Every lod indexes into the same vertex buffer
+	struct Mesh
+	{
+		std::shared_ptr<VertexBuffer<BufferUse::Gpu>> vertices;
+		std::shared_ptr<IndexBuffer<BufferUse::Gpu>> indices;
+		MeshVertexFormat vertexFormat = MeshVertexFormat::Float;
+		uint32_t lodCount = 0;
+		std::array<MeshLod, k_MeshMaxLods> lods;
+		glm::vec4 sphere { 0.0f };
+
+		void bind_cmd(vk::CommandBuffer cmd) const;
+		void draw_cmd(const Context &c, vk::CommandBuffer cmd, uint32_t lod = 0, uint32_t instanceCount = 1) const;
+		// Coarsest lod whose error stays within maxError (relative to the bounding radius)
+		uint32_t select_lod(float maxError) const noexcept;
+	};
+
+	struct MeshUpload
+	{
+		Mesh mesh;
+		// Must outlive the recorded commands
+		std::unique_ptr<VertexBuffer<BufferUse::Staging>> vertexStaging;
+		std::unique_ptr<IndexBuffer<BufferUse::Staging>> indexStaging;
+	};
+
+	// Maps a .idm file written by meshcook and records the copy of its vertex and index data;
+	// the only cpu side work is one memcpy of each straight out of the mapping.
+	std::optional<MeshUpload> load_mesh_cmd(const Context &c, vk::CommandBuffer cmd, const std::string &pth);
+}
+
+#endif
@@ -0,0 +1,72 @@
+/**
+ * Copyright (c) 2022 Connor Mellon
+ * 
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+#ifndef IDIO_GFX_MESHFMT_H
+#define IDIO_GFX_MESHFMT_H
+
+// On disk layout of cooked .idm meshes, shared between the engine and meshcook.
+// Plain little endian PODs so a mapped file can be read in place:
+//   MeshFileHeader | vertices (vertexCount * vertexStride) | indices of every lod, lod 0 first
+namespace idio
+{
+	constexpr uint32_t k_MeshMagic = 0x314D4449; // "IDM1"
+	constexpr uint32_t k_MeshVersion = 1;
+	constexpr uint32_t k_MeshMaxLods = 8;
+	constexpr uint32_t k_MeshDataAlignment = 16;
+
+	enum class MeshVertexFormat : uint32_t
+	{
+		Float, // MeshVertex
+		Packed // MeshVertexPacked
+	};
+
+	struct MeshVertex
+	{
+		float pos[3];
+		float normal[3];
+		float uv[2];
+	};
+
+	// Half the size of MeshVertex: Half4 position (w = 1), Int1010102Snorm normal and Half2 uv
+	struct MeshVertexPacked
+	{
+		uint16_t pos[4];
+		uint32_t normal;
+		uint16_t uv[2];
+	};
+
+	struct MeshLod
+	{
+		uint32_t firstIndex = 0;
+		uint32_t indexCount = 0;
+		float error = 0.0f; // Simplification error relative to the bounding radius
+		uint32_t pad = 0;
+	};
+
+	struct MeshFileHeader
+	{
+		uint32_t magic = k_MeshMagic;
+		uint32_t version = k_MeshVersion;
+		uint32_t vertexStride = sizeof(MeshVertex);
+		uint32_t vertexCount = 0;
+		uint32_t indexSize = 4; // Bytes per index, 2 or 4
+		uint32_t indexCount = 0; // All lods
+		uint32_t lodCount = 0;
+		MeshVertexFormat vertexFormat = MeshVertexFormat::Float;
+		uint64_t vertexOffset = 0; // From the start of the file
+		uint64_t indexOffset = 0;
+		float sphere[4] = {}; // Bounding sphere, centre and radius
+		MeshLod lods[k_MeshMaxLods];
+	};
+
+	static_assert(sizeof(MeshVertex) == 32);
+	static_assert(sizeof(MeshVertexPacked) == 16);
+	static_assert(sizeof(MeshFileHeader) % k_MeshDataAlignment == 0);
+}
+
+#endif
@@ -36,16 +36,27 @@ namespace idio
 	Pipeline::Pipeline(vk::Device dev, const Swapchain &sc,
 		const PipelineCreateInfo &pci) :
 		m_dev(dev),
-		m_swapchain(sc)
+		m_swapchain(sc),
+		m_depthPass(pci.depthPass),
+		m_useDepth(pci.depthTest || pci.depthWrite || pci.depthPass != DepthPass::Main)
 	{
+		const bool hasFrag = !pci.fragmentShaderCode.empty();
+		if(!hasFrag && pci.depthPass != DepthPass::Prepass) {
+			s_EngineLogger->critical("Only depth prepass pipelines can omit the fragment shader");
+			Application::crash();
+		}
+
 		vk::ShaderModuleCreateInfo sci {};
 		sci.codeSize = pci.vertexShaderCode.size();
 		sci.pCode = pci.vertexShaderCode.data();
 		vk::ShaderModule vshader = check_vk(m_dev.createShaderModule(sci), "Failed to create vert shader");
 
-		sci.codeSize = pci.fragmentShaderCode.size();
-		sci.pCode = pci.fragmentShaderCode.data();
-		vk::ShaderModule fshader = check_vk(m_dev.createShaderModule(sci), "Failed to create frag shder");
+		vk::ShaderModule fshader = nullptr;
+		if(hasFrag) {
+			sci.codeSize = pci.fragmentShaderCode.size();
+			sci.pCode = pci.fragmentShaderCode.data();
+			fshader = check_vk(m_dev.createShaderModule(sci), "Failed to create frag shder");
+		}
 
 		vk::PipelineShaderStageCreateInfo vsci {};
 		vsci.pName = "main";
@@ -115,8 +126,28 @@ namespace idio
 		vk::PipelineMultisampleStateCreateInfo msci {};
 		msci.sampleShadingEnable = false;
 
-		//TODO: This is also cool and ideal :)
+		// No depth bounds, stencil or discard, anything that keeps early-Z working
 		vk::PipelineDepthStencilStateCreateInfo dci {};
+		dci.depthBoundsTestEnable = false;
+		dci.stencilTestEnable = false;
+		switch(pci.depthPass) {
+		case DepthPass::Main:
+			dci.depthTestEnable = pci.depthTest;
+			dci.depthWriteEnable = pci.depthWrite;
+			dci.depthCompareOp = pci.depthCompare;
+			break;
+		case DepthPass::Prepass:
+			dci.depthTestEnable = true;
+			dci.depthWriteEnable = true;
+			dci.depthCompareOp = pci.depthCompare;
+			break;
+		case DepthPass::AfterPrepass:
+			// Only the closest surface of each pixel passes, and it's shaded exactly once
+			dci.depthTestEnable = true;
+			dci.depthWriteEnable = false;
+			dci.depthCompareOp = vk::CompareOp::eEqual;
+			break;
+		}
 
 		using enum vk::ColorComponentFlagBits;
 		vk::PipelineColorBlendAttachmentState blendInfo {};
@@ -131,7 +162,7 @@ namespace idio
 
 		vk::PipelineColorBlendStateCreateInfo cbci {};
 		cbci.logicOpEnable = false;
-		cbci.attachmentCount = 1;
+		cbci.attachmentCount = pci.depthPass == DepthPass::Prepass ? 0 : 1;
 		cbci.pAttachments = &blendInfo;
 
 		vk::DynamicState ds[] = {
@@ -144,6 +175,10 @@ namespace idio
 		dsci.pDynamicStates = ds;
 
 		vk::PipelineLayoutCreateInfo plci {};
+		plci.setLayoutCount = static_cast<uint32_t>(pci.setLayouts.size());
+		plci.pSetLayouts = pci.setLayouts.data();
+		plci.pushConstantRangeCount = static_cast<uint32_t>(pci.pushConstantRanges.size());
+		plci.pPushConstantRanges = pci.pushConstantRanges.data();
 		m_layout = check_vk(m_dev.createPipelineLayout(plci), "Failed to create pipeline layout");
 		create_renderpass();
 
@@ -152,7 +187,7 @@ namespace idio
 		ci.subpass = 0;
 		ci.layout = m_layout;
 		ci.renderPass = m_rpass;
-		ci.stageCount = 2;
+		ci.stageCount = hasFrag ? 2 : 1;
 		ci.pStages = stages;
 		ci.pVertexInputState = &vci;
 		ci.pInputAssemblyState = &iaci;
@@ -160,12 +195,14 @@ namespace idio
 		ci.pColorBlendState = &cbci;
 		ci.pMultisampleState = &msci;
 		ci.pRasterizationState = &rci;
+		ci.pDepthStencilState = m_useDepth ? &dci : nullptr;
 		ci.pDynamicState = &dsci;
 		m_handle = check_vk(m_dev.createGraphicsPipeline(nullptr, ci), "Failed to create graphics pipeline");
 
 		m_dev.destroyShaderModule(vshader);
-		m_dev.destroyShaderModule(fshader);
-		m_framebufs.resize(m_swapchain.get_image_views().size());
+		if(hasFrag) {
+			m_dev.destroyShaderModule(fshader);
+		}
 		create_framebuffers();
 	}
 
@@ -182,17 +219,26 @@ namespace idio
 
 	void Pipeline::bind_cmd(vk::CommandBuffer buf) const
 	{
-		vk::ClearValue cv { { std::array<float, 4> { 0.0f, 0.5f, 0.0f, 1.0f } } };
+		// Indexed by attachment, entries for attachments that are loaded are ignored
+		vk::ClearValue cv[2] {};
+		cv[0].color = vk::ClearColorValue { std::array<float, 4> { 0.0f, 0.5f, 0.0f, 1.0f } };
+		cv[1].depthStencil = vk::ClearDepthStencilValue { 1.0f, 0 };
 
 		vk::RenderPassBeginInfo rbi {};
 		rbi.renderPass = m_rpass;
-		rbi.clearValueCount = 1;
-		rbi.pClearValues = &cv;
+		if(m_depthPass == DepthPass::Prepass) {
+			rbi.clearValueCount = 1;
+			rbi.pClearValues = &cv[1];
+		} else {
+			rbi.clearValueCount = m_useDepth ? 2 : 1;
+			rbi.pClearValues = cv;
+		}
 		rbi.renderArea.offset = vk::Offset2D { 0, 0 };
 		rbi.renderArea.extent = vk::Extent2D { m_swapchain.get_extent() };
 		rbi.framebuffer = m_framebufs[m_swapchain.get_current_image_index()];
 		buf.beginRenderPass(rbi, vk::SubpassContents::eInline);
 		buf.bindPipeline(vk::PipelineBindPoint::eGraphics, m_handle);
+		count_metric(EngineMetric::PipelineBinds);
 
 		vk::Viewport vp {};
 		vp.x = 0;
@@ -213,6 +259,20 @@ namespace idio
 		buf.endRenderPass();
 	}
 
+	void Pipeline::bind_sets_cmd(vk::CommandBuffer buf, uint32_t firstSet, std::span<const vk::DescriptorSet> sets,
+		std::span<const uint32_t> dynamicOffsets) const
+	{
+		buf.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, m_layout, firstSet,
+			static_cast<uint32_t>(sets.size()), sets.data(),
+			static_cast<uint32_t>(dynamicOffsets.size()), dynamicOffsets.data());
+	}
+
+	void Pipeline::push_constants_cmd(vk::CommandBuffer buf, vk::ShaderStageFlags stages, uint32_t offset,
+		uint32_t size, const void *data) const
+	{
+		buf.pushConstants(m_layout, stages, offset, size, data);
+	}
+
 	void Pipeline::reset()
 	{
 		for(auto fb : m_framebufs) {
@@ -226,57 +286,167 @@ namespace idio
 
 	void Pipeline::create_renderpass()
 	{
+		const bool useColour = m_depthPass != DepthPass::Prepass;
+		std::vector<vk::AttachmentDescription> attachDescs;
+		std::vector<vk::SubpassDependency> sdeps;
+
 		vk::AttachmentReference colref {};
-		colref.attachment = 0;
 		colref.layout = vk::ImageLayout::eColorAttachmentOptimal;
+		if(useColour) {
+			colref.attachment = static_cast<uint32_t>(attachDescs.size());
+
+			vk::AttachmentDescription attachDesc {};
+			attachDesc.format = m_swapchain.get_format();
+			attachDesc.samples = vk::SampleCountFlagBits::e1; //TODO: Revisit when MS
+			attachDesc.loadOp = vk::AttachmentLoadOp::eClear;
+			attachDesc.storeOp = vk::AttachmentStoreOp::eStore;
+			attachDesc.stencilLoadOp = vk::AttachmentLoadOp::eDontCare;
+			attachDesc.stencilStoreOp = vk::AttachmentStoreOp::eDontCare;
+			attachDesc.initialLayout = vk::ImageLayout::eUndefined;
+			attachDesc.finalLayout = vk::ImageLayout::ePresentSrcKHR;
+			attachDescs.push_back(attachDesc);
+
+			vk::SubpassDependency sdep {};
+			sdep.srcSubpass = VK_SUBPASS_EXTERNAL;
+			sdep.dstSubpass = 0;
+			sdep.srcAccessMask = vk::AccessFlagBits::eNone;
+			sdep.dstAccessMask = vk::AccessFlagBits::eColorAttachmentWrite;
+			sdep.srcStageMask = vk::PipelineStageFlagBits::eColorAttachmentOutput;
+			sdep.dstStageMask = vk::PipelineStageFlagBits::eColorAttachmentOutput;
+			sdeps.push_back(sdep);
+		}
 
-		vk::AttachmentDescription attachDesc {};
-		attachDesc.format = m_swapchain.get_format();
-		attachDesc.samples = vk::SampleCountFlagBits::e1; //TODO: Revisit when MS
-		attachDesc.loadOp = vk::AttachmentLoadOp::eClear;
-		attachDesc.storeOp = vk::AttachmentStoreOp::eStore;
-		attachDesc.stencilLoadOp = vk::AttachmentLoadOp::eDontCare;
-		attachDesc.stencilStoreOp = vk::AttachmentStoreOp::eDontCare;
-		attachDesc.initialLayout = vk::ImageLayout::eUndefined;
-		attachDesc.finalLayout = vk::ImageLayout::ePresentSrcKHR;
-
-		vk::SubpassDependency sdep {};
-		sdep.srcSubpass = VK_SUBPASS_EXTERNAL;
-		sdep.dstSubpass = 0;
-		sdep.srcAccessMask = vk::AccessFlagBits::eNone;
-		sdep.dstAccessMask = vk::AccessFlagBits::eColorAttachmentWrite;
-		sdep.srcStageMask = vk::PipelineStageFlagBits::eColorAttachmentOutput;
-		sdep.dstStageMask = vk::PipelineStageFlagBits::eColorAttachmentOutput;
+		vk::AttachmentReference depthref {};
+		depthref.layout = vk::ImageLayout::eDepthStencilAttachmentOptimal;
+		if(m_useDepth) {
+			depthref.attachment = static_cast<uint32_t>(attachDescs.size());
+
+			// Only the prepass keeps its depth around, for the pass that follows it
+			vk::AttachmentDescription attachDesc {};
+			attachDesc.format = m_swapchain.get_depth_format();
+			attachDesc.samples = vk::SampleCountFlagBits::e1;
+			attachDesc.loadOp = m_depthPass == DepthPass::AfterPrepass ? vk::AttachmentLoadOp::eLoad : vk::AttachmentLoadOp::eClear;
+			attachDesc.storeOp = m_depthPass == DepthPass::Prepass ? vk::AttachmentStoreOp::eStore : vk::AttachmentStoreOp::eDontCare;
+			attachDesc.stencilLoadOp = vk::AttachmentLoadOp::eDontCare;
+			attachDesc.stencilStoreOp = vk::AttachmentStoreOp::eDontCare;
+			attachDesc.initialLayout = m_depthPass == DepthPass::AfterPrepass ?
+				vk::ImageLayout::eDepthStencilAttachmentOptimal : vk::ImageLayout::eUndefined;
+			attachDesc.finalLayout = vk::ImageLayout::eDepthStencilAttachmentOptimal;
+			attachDescs.push_back(attachDesc);
+
+			// The depth buffer is shared by every frame in flight, so this also orders a frame's
+			// clear after the previous frame's depth tests
+			using enum vk::PipelineStageFlagBits;
+			vk::SubpassDependency sdep {};
+			sdep.srcSubpass = VK_SUBPASS_EXTERNAL;
+			sdep.dstSubpass = 0;
+			sdep.srcAccessMask = vk::AccessFlagBits::eDepthStencilAttachmentWrite;
+			sdep.dstAccessMask = vk::AccessFlagBits::eDepthStencilAttachmentRead | vk::AccessFlagBits::eDepthStencilAttachmentWrite;
+			sdep.srcStageMask = eEarlyFragmentTests | eLateFragmentTests;
+			sdep.dstStageMask = eEarlyFragmentTests | eLateFragmentTests;
+			sdeps.push_back(sdep);
+		}
 
 		vk::SubpassDescription subpass {};
-		subpass.colorAttachmentCount = 1;
-		subpass.pColorAttachments = &colref;
+		subpass.colorAttachmentCount = useColour ? 1 : 0;
+		subpass.pColorAttachments = useColour ? &colref : nullptr;
+		subpass.pDepthStencilAttachment = m_useDepth ? &depthref : nullptr;
 		subpass.pipelineBindPoint = vk::PipelineBindPoint::eGraphics;
 
 		vk::RenderPassCreateInfo rci {};
-		rci.attachmentCount = 1;
-		rci.pAttachments = &attachDesc;
+		rci.attachmentCount = static_cast<uint32_t>(attachDescs.size());
+		rci.pAttachments = attachDescs.data();
 		rci.subpassCount = 1;
 		rci.pSubpasses = &subpass;
-		rci.dependencyCount = 1;
-		rci.pDependencies = &sdep;
+		rci.dependencyCount = static_cast<uint32_t>(sdeps.size());
+		rci.pDependencies = sdeps.data();
 		m_rpass = check_vk(m_dev.createRenderPass(rci), "Failed to create renderpass");
 	}
 
 	void Pipeline::create_framebuffers()
 	{
+		// The image count changes along with the present mode
 		auto imviews = m_swapchain.get_image_views();
+		m_framebufs.resize(imviews.size());
 		for(size_t i = 0; i < imviews.size(); i++) {
-			vk::ImageView attachments[] = { imviews[i] };
+			std::array<vk::ImageView, 2> attachments {};
+			uint32_t count = 0;
+			if(m_depthPass != DepthPass::Prepass) {
+				attachments[count++] = imviews[i];
+			}
+			if(m_useDepth) {
+				attachments[count++] = m_swapchain.get_depth_view();
+			}
 
 			vk::FramebufferCreateInfo ci {};
 			ci.layers = 1;
 			ci.renderPass = m_rpass;
-			ci.attachmentCount = 1;
-			ci.pAttachments = attachments;
+			ci.attachmentCount = count;
+			ci.pAttachments = attachments.data();
 			ci.width = m_swapchain.get_extent().width;
 			ci.height = m_swapchain.get_extent().height;
 			m_framebufs[i] = check_vk(m_dev.createFramebuffer(ci), "Cannot create pipeline framebuffer");
 		}
 	}
-}
+
+
+	ComputePipeline::ComputePipeline(vk::Device dev, const ComputePipelineCreateInfo &pci) :
+		m_dev(dev)
+	{
+		vk::ShaderModuleCreateInfo sci {};
+		sci.codeSize = pci.shaderCode.size();
+		sci.pCode = pci.shaderCode.data();
+		vk::ShaderModule shader = check_vk(m_dev.createShaderModule(sci), "Failed to create compute shader");
+
+		vk::PipelineLayoutCreateInfo plci {};
+		plci.setLayoutCount = static_cast<uint32_t>(pci.setLayouts.size());
+		plci.pSetLayouts = pci.setLayouts.data();
+		plci.pushConstantRangeCount = static_cast<uint32_t>(pci.pushConstantRanges.size());
+		plci.pPushConstantRanges = pci.pushConstantRanges.data();
+		m_layout = check_vk(m_dev.createPipelineLayout(plci), "Failed to create compute pipeline layout");
+
+		vk::ComputePipelineCreateInfo ci {};
+		ci.layout = m_layout;
+		ci.stage.pName = "main";
+		ci.stage.module = shader;
+		ci.stage.stage = vk::ShaderStageFlagBits::eCompute;
+		m_handle = check_vk(m_dev.createComputePipeline(nullptr, ci), "Failed to create compute pipeline");
+
+		m_dev.destroyShaderModule(shader);
+	}
+
+	ComputePipeline::~ComputePipeline()
+	{
+		m_dev.destroyPipeline(m_handle);
+		m_dev.destroyPipelineLayout(m_layout);
+	}
+
+	void ComputePipeline::bind_cmd(vk::CommandBuffer buf) const
+	{
+		buf.bindPipeline(vk::PipelineBindPoint::eCompute, m_handle);
+		count_metric(EngineMetric::PipelineBinds);
+	}
+
+	void ComputePipeline::bind_sets_cmd(vk::CommandBuffer buf, uint32_t firstSet, std::span<const vk::DescriptorSet> sets,
+		std::span<const uint32_t> dynamicOffsets) const
+	{
+		buf.bindDescriptorSets(vk::PipelineBindPoint::eCompute, m_layout, firstSet,
+			static_cast<uint32_t>(sets.size()), sets.data(),
+			static_cast<uint32_t>(dynamicOffsets.size()), dynamicOffsets.data());
+	}
+
+	void ComputePipeline::push_constants_cmd(vk::CommandBuffer buf, uint32_t offset, uint32_t size, const void *data) const
+	{
+		buf.pushConstants(m_layout, vk::ShaderStageFlagBits::eCompute, offset, size, data);
+	}
+
+	void ComputePipeline::dispatch_cmd(vk::CommandBuffer buf, uint32_t x, uint32_t y, uint32_t z) const
+	{
+		buf.dispatch(x, y, z);
+	}
+
+	void ComputePipeline::dispatch_indirect_cmd(vk::CommandBuffer buf, vk::Buffer args, vk::DeviceSize offset) const
+	{
+		buf.dispatchIndirect(args, offset);
+	}
+}
\ No newline at end of file
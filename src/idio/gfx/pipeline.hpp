@@ -22,12 +22,24 @@ namespace idio
 		bool instance = false;
 	};
 
+	// Packed formats (see quantise.hpp) are expanded to floats by the vertex fetch.
+	// There's no 3 component half or 8/16 bit format, those are poorly supported as vertex inputs.
 	enum class AttribFormat
 	{
 		Float = VK_FORMAT_R32_SFLOAT,
 		Vec2 = VK_FORMAT_R32G32_SFLOAT,
 		Vec3 = VK_FORMAT_R32G32B32_SFLOAT,
-		Vec4 = VK_FORMAT_R32G32B32A32_SFLOAT
+		Vec4 = VK_FORMAT_R32G32B32A32_SFLOAT,
+		Half2 = VK_FORMAT_R16G16_SFLOAT,
+		Half4 = VK_FORMAT_R16G16B16A16_SFLOAT,
+		Byte4Snorm = VK_FORMAT_R8G8B8A8_SNORM,
+		Byte4Unorm = VK_FORMAT_R8G8B8A8_UNORM,
+		Short2Snorm = VK_FORMAT_R16G16_SNORM,
+		Short2Unorm = VK_FORMAT_R16G16_UNORM,
+		Short4Snorm = VK_FORMAT_R16G16B16A16_SNORM,
+		Short4Unorm = VK_FORMAT_R16G16B16A16_UNORM,
+		Int1010102Snorm = VK_FORMAT_A2B10G10R10_SNORM_PACK32,
+		Int1010102Unorm = VK_FORMAT_A2B10G10R10_UNORM_PACK32
 	};
 
 	struct AttributeDescription
@@ -38,6 +50,17 @@ namespace idio
 		AttribFormat format = AttribFormat::Float;
 	};
 
+	// How a pipeline's render pass treats the swapchain's depth buffer.
+	// A prepass lays down depth for the opaque geometry first so the shading pass only runs
+	// the fragment shader once per pixel. Both passes must produce bit identical positions,
+	// declare gl_Position as invariant in vertex shaders used for both.
+	enum class DepthPass
+	{
+		Main,         // Clears colour, and depth when depth is tested or written
+		Prepass,      // Clears and writes depth only, the fragment shader is optional
+		AfterPrepass  // Clears colour and tests against the prepass depth with eEqual, depth is never written
+	};
+
 	struct PipelineCreateInfo
 	{
 		std::string cacheName;
@@ -49,8 +72,16 @@ namespace idio
 		vk::PolygonMode polyMode = vk::PolygonMode::eFill;
 		vk::PrimitiveTopology topology = vk::PrimitiveTopology::eTriangleList;
 
+		bool depthTest = false;
+		bool depthWrite = false;
+		vk::CompareOp depthCompare = vk::CompareOp::eLess;
+		DepthPass depthPass = DepthPass::Main;
+
 		std::vector<VertexLayout> vertexLayouts;
 		std::vector<AttributeDescription> attributeDescs;
+
+		std::vector<vk::DescriptorSetLayout> setLayouts;
+		std::vector<vk::PushConstantRange> pushConstantRanges;
 	};
 
 	class Pipeline
@@ -62,6 +93,17 @@ namespace idio
 		void reset();
 		void bind_cmd(vk::CommandBuffer buf) const;
 		void unbind_cmd(vk::CommandBuffer buf) const;
+
+		void bind_sets_cmd(vk::CommandBuffer buf, uint32_t firstSet, std::span<const vk::DescriptorSet> sets,
+			std::span<const uint32_t> dynamicOffsets = {}) const;
+		void push_constants_cmd(vk::CommandBuffer buf, vk::ShaderStageFlags stages, uint32_t offset,
+			uint32_t size, const void *data) const;
+
+		template<typename T>
+		void push_constants_cmd(vk::CommandBuffer buf, vk::ShaderStageFlags stages, const T &data, uint32_t offset = 0) const
+		{
+			push_constants_cmd(buf, stages, offset, sizeof(T), &data);
+		}
 	private:
 		vk::Device m_dev;
 		const Swapchain &m_swapchain;
@@ -70,10 +112,52 @@ namespace idio
 		vk::PipelineLayout m_layout;
 		vk::RenderPass m_rpass;
 		std::vector<vk::Framebuffer> m_framebufs;
+		DepthPass m_depthPass;
+		bool m_useDepth;
 
 		void create_renderpass();
 		void create_framebuffers();
 	};
+
+	struct ComputePipelineCreateInfo
+	{
+		std::vector<uint32_t> shaderCode;
+		std::vector<vk::DescriptorSetLayout> setLayouts;
+		std::vector<vk::PushConstantRange> pushConstantRanges;
+	};
+
+	class ComputePipeline
+	{
+	public:
+		ComputePipeline(vk::Device dev, const ComputePipelineCreateInfo &pci);
+		~ComputePipeline();
+		ComputePipeline(const ComputePipeline &o) = delete;
+		ComputePipeline &operator=(const ComputePipeline &o) = delete;
+
+		void bind_cmd(vk::CommandBuffer buf) const;
+		void bind_sets_cmd(vk::CommandBuffer buf, uint32_t firstSet, std::span<const vk::DescriptorSet> sets,
+			std::span<const uint32_t> dynamicOffsets = {}) const;
+		void push_constants_cmd(vk::CommandBuffer buf, uint32_t offset, uint32_t size, const void *data) const;
+
+		template<typename T>
+		void push_constants_cmd(vk::CommandBuffer buf, const T &data, uint32_t offset = 0) const
+		{
+			push_constants_cmd(buf, offset, sizeof(T), &data);
+		}
+
+		void dispatch_cmd(vk::CommandBuffer buf, uint32_t x, uint32_t y = 1, uint32_t z = 1) const;
+		void dispatch_indirect_cmd(vk::CommandBuffer buf, vk::Buffer args, vk::DeviceSize offset) const;
+
+		// Enough groups of groupSize to cover every item
+		static constexpr uint32_t group_count(uint32_t items, uint32_t groupSize) noexcept
+		{
+			return (items + groupSize - 1) / groupSize;
+		}
+	private:
+		vk::Device m_dev;
+		vk::Pipeline m_handle;
+		vk::PipelineLayout m_layout;
+	};
 }
 
 #endif
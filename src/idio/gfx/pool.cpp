@@ -0,0 +1,296 @@
+/**
+ * Copyright (c) 2022 Connor Mellon
+ * 
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+#include "pch.hpp"
+#include "buffer.hpp"
+#include "pool.hpp"
+
+#include "vkutl.hpp"
+#include "device.hpp"
+#include "context.hpp"
+
+namespace idio
+{
+	template<BufferType T>
+	BufferPool<T>::BufferPool(Context &c, vk::DeviceSize blockSize) :
+		m_context(c), m_blockSize(blockSize)
+	{
+		m_frameTask = c.add_frame_task([this](vk::CommandBuffer cmd) { defragment_cmd(cmd, m_defragBudget); });
+
+		const auto &limits = c.get_physdev().props.limits;
+		if constexpr(T == BufferType::Storage) {
+			m_minAlignment = limits.minStorageBufferOffsetAlignment;
+		} else if constexpr(T == BufferType::Uniform) {
+			m_minAlignment = limits.minUniformBufferOffsetAlignment;
+		}
+	}
+
+	template<BufferType T>
+	BufferPool<T>::~BufferPool()
+	{
+		m_context.remove_frame_task(m_frameTask);
+		for(auto &b : m_blocks) {
+			if(b.virt != VK_NULL_HANDLE) {
+				vmaClearVirtualBlock(b.virt);
+				vmaDestroyVirtualBlock(b.virt);
+			}
+		}
+	}
+
+	template<BufferType T>
+	const BufferSlice *BufferPool<T>::allocate(vk::DeviceSize sz, vk::DeviceSize alignment)
+	{
+		m_context.check_frame_thread("BufferPool::allocate");
+		VmaVirtualAllocationCreateInfo aci {};
+		aci.size = sz;
+		aci.alignment = std::max(alignment, m_minAlignment);
+
+		release_retired();
+
+		VmaVirtualAllocation alloc = VK_NULL_HANDLE;
+		vk::DeviceSize offset = 0;
+		uint32_t block = 0;
+		for(; block < m_blocks.size(); block++) {
+			if(try_allocate(block, aci, alloc, offset)) {
+				break;
+			}
+		}
+
+		if(block == m_blocks.size()) {
+			block = add_block(sz);
+			check_vk(vmaVirtualAllocate(m_blocks[block].virt, &aci, &alloc, &offset), "Failed to sub-allocate buffer");
+		}
+
+		BufferSlice *slice = nullptr;
+		if(m_freeSlices.empty()) {
+			slice = &m_slices.emplace_back();
+		} else {
+			slice = m_freeSlices.back();
+			m_freeSlices.pop_back();
+		}
+
+		slice->buffer = *m_blocks[block].buffer;
+		slice->offset = offset;
+		slice->size = sz;
+		slice->block = block;
+		slice->alignment = aci.alignment;
+		slice->alloc = alloc;
+		return slice;
+	}
+
+	template<BufferType T>
+	void BufferPool<T>::free(const BufferSlice *slice)
+	{
+		if(slice == nullptr) {
+			return;
+		}
+
+		m_context.check_frame_thread("BufferPool::free");
+		// In-flight frames may still read the range, so it's only reused once they retire
+		auto s = const_cast<BufferSlice *>(slice);
+		m_retired.push_back(Retired { s->block, s->alloc, m_context.get_frame_number() });
+		*s = BufferSlice {};
+		m_freeSlices.push_back(s);
+	}
+
+	template<BufferType T>
+	void BufferPool<T>::copy_from(vk::CommandBuffer cmd, Buffer<T, BufferUse::Staging> &src, const BufferSlice &dst,
+		size_t sz, size_t srcOffset, size_t dstOffset)
+	{
+		m_blocks[dst.block].buffer->copy_from(cmd, src, sz, srcOffset, dst.offset + dstOffset);
+	}
+
+	template<BufferType T>
+	void BufferPool<T>::defragment_cmd(vk::CommandBuffer cmd, vk::DeviceSize maxBytes)
+	{
+		constexpr double sparseFill = 0.5;
+
+		release_retired();
+		release_empty_blocks();
+		if(maxBytes == 0) {
+			return;
+		}
+
+		uint32_t src = std::numeric_limits<uint32_t>::max();
+		uint32_t liveBlocks = 0;
+		double minFill = sparseFill;
+		for(uint32_t i = 0; i < m_blocks.size(); i++) {
+			if(m_blocks[i].virt == VK_NULL_HANDLE) {
+				continue;
+			}
+
+			liveBlocks++;
+			VmaStatistics st {};
+			vmaGetVirtualBlockStatistics(m_blocks[i].virt, &st);
+			const double fill = static_cast<double>(st.allocationBytes) / static_cast<double>(m_blocks[i].size);
+			if(st.allocationCount != 0 && fill < minFill) {
+				minFill = fill;
+				src = i;
+			}
+		}
+
+		if(liveBlocks < 2 || src == std::numeric_limits<uint32_t>::max()) {
+			return;
+		}
+
+		vk::DeviceSize moved = 0;
+		const vk::Buffer srcBuffer = *m_blocks[src].buffer;
+		for(auto &slice : m_slices) {
+			if(moved >= maxBytes) {
+				break;
+			}
+
+			if(slice.alloc == VK_NULL_HANDLE || slice.block != src) {
+				continue;
+			}
+
+			VmaVirtualAllocationCreateInfo aci {};
+			aci.size = slice.size;
+			aci.alignment = slice.alignment;
+
+			VmaVirtualAllocation alloc = VK_NULL_HANDLE;
+			vk::DeviceSize offset = 0;
+			uint32_t dst = 0;
+			for(; dst < m_blocks.size(); dst++) {
+				if(dst != src && try_allocate(dst, aci, alloc, offset)) {
+					break;
+				}
+			}
+
+			if(dst == m_blocks.size()) {
+				continue;
+			}
+
+			if(moved == 0) {
+				vk::MemoryBarrier mb {};
+				mb.srcAccessMask = vk::AccessFlagBits::eMemoryWrite;
+				mb.dstAccessMask = vk::AccessFlagBits::eTransferRead | vk::AccessFlagBits::eTransferWrite;
+				cmd.pipelineBarrier(vk::PipelineStageFlagBits::eAllCommands, vk::PipelineStageFlagBits::eTransfer,
+					{}, mb, nullptr, nullptr);
+			}
+
+			vk::BufferCopy region {};
+			region.size = slice.size;
+			region.srcOffset = slice.offset;
+			region.dstOffset = offset;
+			cmd.copyBuffer(srcBuffer, *m_blocks[dst].buffer, region);
+
+			m_retired.push_back(Retired { src, slice.alloc, m_context.get_frame_number() });
+			slice.buffer = *m_blocks[dst].buffer;
+			slice.offset = offset;
+			slice.block = dst;
+			slice.alloc = alloc;
+			moved += slice.size;
+		}
+
+		if(moved != 0) {
+			vk::MemoryBarrier mb {};
+			mb.srcAccessMask = vk::AccessFlagBits::eTransferWrite;
+			mb.dstAccessMask = vk::AccessFlagBits::eMemoryRead | vk::AccessFlagBits::eMemoryWrite;
+			cmd.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eAllCommands,
+				{}, mb, nullptr, nullptr);
+			s_EngineLogger->trace("Buffer pool moved {} bytes out of block {}", moved, src);
+		}
+	}
+
+	template<BufferType T>
+	size_t BufferPool<T>::get_block_count() const
+	{
+		return static_cast<size_t>(std::count_if(m_blocks.begin(), m_blocks.end(),
+			[](const Block &b) { return b.virt != VK_NULL_HANDLE; }));
+	}
+
+	template<BufferType T>
+	uint32_t BufferPool<T>::add_block(vk::DeviceSize minSize)
+	{
+		Block b {};
+		b.size = std::max(minSize, m_blockSize);
+		b.buffer = std::make_unique<Buffer<T, BufferUse::Gpu>>(m_context, b.size);
+
+		VmaVirtualBlockCreateInfo vci {};
+		vci.size = b.size;
+		check_vk(vmaCreateVirtualBlock(&vci, &b.virt), "Failed to create virtual block");
+
+		// Reuse the slot of a released block so slice block indices stay stable
+		auto it = std::find_if(m_blocks.begin(), m_blocks.end(), [](const Block &o) { return o.virt == VK_NULL_HANDLE; });
+		if(it != m_blocks.end()) {
+			*it = std::move(b);
+			return static_cast<uint32_t>(it - m_blocks.begin());
+		}
+
+		m_blocks.push_back(std::move(b));
+		s_EngineLogger->trace("Buffer pool grew to {} blocks", m_blocks.size());
+		return static_cast<uint32_t>(m_blocks.size() - 1);
+	}
+
+	template<BufferType T>
+	void BufferPool<T>::release_retired()
+	{
+		// Frames older than this have finished on the gpu
+		const uint64_t frame = m_context.get_frame_number();
+		auto done = std::partition(m_retired.begin(), m_retired.end(),
+			[&](const Retired &r) { return r.frame + m_context.get_frames_in_flight() > frame; });
+
+		for(auto it = done; it != m_retired.end(); it++) {
+			vmaVirtualFree(m_blocks[it->block].virt, it->alloc);
+		}
+		m_retired.erase(done, m_retired.end());
+	}
+
+	template<BufferType T>
+	void BufferPool<T>::release_empty_blocks()
+	{
+		// Retired ranges are still allocated, so an empty block is unused by any frame in flight
+		for(auto &b : m_blocks) {
+			if(b.virt != VK_NULL_HANDLE && vmaIsVirtualBlockEmpty(b.virt)) {
+				vmaDestroyVirtualBlock(b.virt);
+				b = Block {};
+			}
+		}
+	}
+
+	template<BufferType T>
+	bool BufferPool<T>::try_allocate(uint32_t block, const VmaVirtualAllocationCreateInfo &aci,
+		VmaVirtualAllocation &alloc, vk::DeviceSize &offset)
+	{
+		if(m_blocks[block].virt == VK_NULL_HANDLE) {
+			return false;
+		}
+
+		return vmaVirtualAllocate(m_blocks[block].virt, &aci, &alloc, &offset) == VK_SUCCESS;
+	}
+
+
+	void bind_vertex_slices(vk::CommandBuffer cmd, std::span<const BufferSlice *const> slices, uint32_t firstBinding)
+	{
+		constexpr size_t maxBindings = 16;
+		if(slices.size() > maxBindings) {
+			s_EngineLogger->critical("Too many vertex bindings ({})", slices.size());
+			Application::crash();
+		}
+
+		std::array<vk::Buffer, maxBindings> hdls;
+		std::array<vk::DeviceSize, maxBindings> offsets;
+		for(size_t i = 0; i < slices.size(); i++) {
+			hdls[i] = slices[i]->buffer;
+			offsets[i] = slices[i]->offset;
+		}
+
+		cmd.bindVertexBuffers(firstBinding, static_cast<uint32_t>(slices.size()), hdls.data(), offsets.data());
+	}
+
+	void bind_index_slice(vk::CommandBuffer cmd, const BufferSlice &slice, vk::IndexType type)
+	{
+		cmd.bindIndexBuffer(slice.buffer, slice.offset, type);
+	}
+
+	template class BufferPool<BufferType::Vertex>;
+	template class BufferPool<BufferType::Index>;
+	template class BufferPool<BufferType::Storage>;
+	template class BufferPool<BufferType::Indirect>;
+}
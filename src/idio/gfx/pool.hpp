@@ -0,0 +1,98 @@
+/**
+ * Copyright (c) 2022 Connor Mellon
+ * 
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+#ifndef IDIO_GFX_POOL_H
+#define IDIO_GFX_POOL_H
+
+namespace idio
+{
+	class Context;
+
+	// A range of one of a pool's buffers. Handles stay valid until freed.
+	struct BufferSlice
+	{
+		vk::Buffer buffer;
+		vk::DeviceSize offset = 0;
+		vk::DeviceSize size = 0;
+
+		uint32_t block = 0;
+		vk::DeviceSize alignment = 1;
+		VmaVirtualAllocation alloc = VK_NULL_HANDLE;
+	};
+
+	// Sub-allocates a handful of large gpu buffers through VMA virtual blocks,
+	// so thousands of meshes share a few VkBuffers. The engine compacts every pool a little each
+	// frame (see Context::add_frame_task), recycling freed ranges and releasing empty blocks.
+	template<BufferType T>
+	class BufferPool
+	{
+	public:
+		explicit BufferPool(Context &c, vk::DeviceSize blockSize = 64 * 1024 * 1024);
+		~BufferPool();
+		BufferPool(const BufferPool &o) = delete;
+		BufferPool &operator=(const BufferPool &o) = delete;
+
+		// allocate, free and copy_from share state with the engine's defrag task, so they belong on the
+		// frame thread (render_packet or tick, or init() before frames start)
+		const BufferSlice *allocate(vk::DeviceSize sz, vk::DeviceSize alignment = 16);
+		// The range is recycled once the frames in flight that may use it have finished
+		void free(const BufferSlice *slice);
+
+		void copy_from(vk::CommandBuffer cmd, Buffer<T, BufferUse::Staging> &src, const BufferSlice &dst,
+			size_t sz, size_t srcOffset, size_t dstOffset = 0);
+
+		// Incrementally empties the sparsest block into the others, moving at most maxBytes per call.
+		// Slices are updated in place; the old ranges stay alive until the frames using them retire.
+		// Already recorded every frame with the defrag budget, calling it directly moves more at once.
+		void defragment_cmd(vk::CommandBuffer cmd, vk::DeviceSize maxBytes = 4 * 1024 * 1024);
+		// Bytes moved per frame by the engine, 0 only recycles ranges and releases blocks
+		void set_defrag_budget(vk::DeviceSize bytesPerFrame) { m_defragBudget = bytesPerFrame; }
+
+		size_t get_block_count() const;
+	private:
+		struct Block
+		{
+			std::unique_ptr<Buffer<T, BufferUse::Gpu>> buffer;
+			VmaVirtualBlock virt = VK_NULL_HANDLE;
+			vk::DeviceSize size = 0;
+		};
+
+		struct Retired
+		{
+			uint32_t block;
+			VmaVirtualAllocation alloc;
+			uint64_t frame;
+		};
+
+		Context &m_context;
+		vk::DeviceSize m_blockSize;
+		vk::DeviceSize m_minAlignment = 1;
+		vk::DeviceSize m_defragBudget = 4 * 1024 * 1024;
+		uint64_t m_frameTask; // FrameTaskId
+
+		std::vector<Block> m_blocks;
+		std::deque<BufferSlice> m_slices;
+		std::vector<BufferSlice *> m_freeSlices;
+		std::vector<Retired> m_retired;
+
+		uint32_t add_block(vk::DeviceSize minSize);
+		void release_retired();
+		void release_empty_blocks();
+		bool try_allocate(uint32_t block, const VmaVirtualAllocationCreateInfo &aci, VmaVirtualAllocation &alloc, vk::DeviceSize &offset);
+	};
+
+	using VertexPool = BufferPool<BufferType::Vertex>;
+	using IndexPool = BufferPool<BufferType::Index>;
+	using StoragePool = BufferPool<BufferType::Storage>;
+
+	// All slices go out in one bindVertexBuffers starting at firstBinding
+	void bind_vertex_slices(vk::CommandBuffer cmd, std::span<const BufferSlice *const> slices, uint32_t firstBinding = 0);
+	void bind_index_slice(vk::CommandBuffer cmd, const BufferSlice &slice, vk::IndexType type);
+}
+
+#endif
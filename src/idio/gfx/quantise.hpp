@@ -0,0 +1,90 @@
+/**
+ * Copyright (c) 2022 Connor Mellon
+ * 
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+#ifndef IDIO_GFX_QUANTISE_H
+#define IDIO_GFX_QUANTISE_H
+
+// Packing helpers for the compact AttribFormats, also used offline by meshcook
+namespace idio
+{
+	// Round to nearest even, overflow goes to infinity
+	inline uint16_t quantise_half(float v) noexcept
+	{
+		const uint32_t f = std::bit_cast<uint32_t>(v);
+		const uint32_t sign = (f >> 16) & 0x8000;
+		const uint32_t absf = f & 0x7FFFFFFF;
+		if(absf >= 0x7F800000) {
+			return static_cast<uint16_t>(sign | 0x7C00 | (absf > 0x7F800000 ? 0x200 : 0)); // Keep NaNs NaN
+		}
+
+		if(absf >= 0x477FF000) {
+			return static_cast<uint16_t>(sign | 0x7C00);
+		}
+
+		uint32_t h, rem, halfway;
+		if(absf < 0x38800000) {
+			// Denormal half, shift the mantissa with its implicit bit down into place
+			const uint32_t shift = 126 - (absf >> 23);
+			if(shift > 24) {
+				return static_cast<uint16_t>(sign);
+			}
+
+			const uint32_t mant = (absf & 0x7FFFFF) | 0x800000;
+			h = mant >> shift;
+			rem = mant & ((1u << shift) - 1);
+			halfway = 1u << (shift - 1);
+		} else {
+			h = (absf - 0x38000000) >> 13; // Rebias the exponent from 127 to 15
+			rem = absf & 0x1FFF;
+			halfway = 0x1000;
+		}
+
+		if(rem > halfway || (rem == halfway && (h & 1))) {
+			h++;
+		}
+
+		return static_cast<uint16_t>(sign | h);
+	}
+
+	inline int8_t quantise_snorm8(float v) noexcept
+	{
+		return static_cast<int8_t>(std::lround(std::clamp(v, -1.0f, 1.0f) * 127.0f));
+	}
+
+	inline uint8_t quantise_unorm8(float v) noexcept
+	{
+		return static_cast<uint8_t>(std::lround(std::clamp(v, 0.0f, 1.0f) * 255.0f));
+	}
+
+	inline int16_t quantise_snorm16(float v) noexcept
+	{
+		return static_cast<int16_t>(std::lround(std::clamp(v, -1.0f, 1.0f) * 32767.0f));
+	}
+
+	inline uint16_t quantise_unorm16(float v) noexcept
+	{
+		return static_cast<uint16_t>(std::lround(std::clamp(v, 0.0f, 1.0f) * 65535.0f));
+	}
+
+	// AttribFormat::Int1010102Snorm, x in the low bits. Meant for normals and tangents (w as handedness).
+	inline uint32_t pack_snorm_1010102(float x, float y, float z, float w = 0.0f) noexcept
+	{
+		const auto s10 = [](float c) { return static_cast<uint32_t>(std::lround(std::clamp(c, -1.0f, 1.0f) * 511.0f)) & 0x3FF; };
+		const auto s2 = static_cast<uint32_t>(std::lround(std::clamp(w, -1.0f, 1.0f))) & 0x3;
+		return s10(x) | (s10(y) << 10) | (s10(z) << 20) | (s2 << 30);
+	}
+
+	inline uint32_t pack_unorm_1010102(float x, float y, float z, float w = 0.0f) noexcept
+	{
+		const auto u10 = [](float c) { return static_cast<uint32_t>(std::lround(std::clamp(c, 0.0f, 1.0f) * 1023.0f)); };
+		const auto u2 = static_cast<uint32_t>(std::lround(std::clamp(w, 0.0f, 1.0f) * 3.0f));
+		return u10(x) | (u10(y) << 10) | (u10(z) << 20) | (u2 << 30);
+	}
+}
+
+#endif
@@ -0,0 +1,235 @@
+/**
+ * Copyright (c) 2022 Connor Mellon
+ * 
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+#include "pch.hpp"
+#include "buffer.hpp"
+#include "streamer.hpp"
+
+#include "vkutl.hpp"
+#include "device.hpp"
+#include "context.hpp"
+#include "core/file.hpp"
+
+namespace idio
+{
+	AssetStreamer::AssetStreamer(Context &c, size_t maxBytesInFlight) :
+		m_context(c),
+		m_maxBytesInFlight(maxBytesInFlight),
+		m_cmdpool(std::make_unique<CommandPool>(c, true))
+	{
+		m_thread = std::thread(&AssetStreamer::io_thread, this);
+	}
+
+	AssetStreamer::~AssetStreamer()
+	{
+		{
+			std::lock_guard lock(m_mutex);
+			m_stop = true;
+		}
+		m_cv.notify_all();
+		m_thread.join();
+
+		if(!m_batches.empty()) {
+			check_vk(m_context.get_device().waitIdle(), "Failed to wait for uploads");
+		}
+	}
+
+	StreamHandle AssetStreamer::request(StreamRequest &&req)
+	{
+		std::unique_lock lock(m_mutex);
+		auto job = std::make_shared<Job>();
+		job->handle = m_nextHandle++;
+		job->req = std::move(req);
+		m_jobs.emplace(job->handle, job);
+		m_queue.push(job);
+		lock.unlock();
+
+		m_cv.notify_all();
+		return job->handle;
+	}
+
+	bool AssetStreamer::cancel(StreamHandle h)
+	{
+		std::lock_guard lock(m_mutex);
+		auto it = m_jobs.find(h);
+		if(it == m_jobs.end()) {
+			return false;
+		}
+
+		auto &job = *it->second;
+		if(job.state != StreamState::Queued && job.state != StreamState::Reading) {
+			return false;
+		}
+
+		// Whoever holds the job next (io thread or pump) releases its staging memory
+		job.state = StreamState::Cancelled;
+		m_finished.push_back(h);
+		return true;
+	}
+
+	StreamState AssetStreamer::get_state(StreamHandle h) const
+	{
+		std::lock_guard lock(m_mutex);
+		auto it = m_jobs.find(h);
+		return it == m_jobs.end() ? StreamState::Unknown : it->second->state;
+	}
+
+	void AssetStreamer::pump()
+	{
+		{
+			// Jobs that finished since the last pump have had a frame to be queried
+			std::lock_guard lock(m_mutex);
+			for(auto h : m_finished) {
+				auto it = m_jobs.find(h);
+				if(it != m_jobs.end() && it->second->state != StreamState::Queued && it->second->state != StreamState::Reading) {
+					m_jobs.erase(it);
+				}
+			}
+			m_finished.clear();
+		}
+
+		// Uploads submitted on earlier frames
+		for(auto it = m_batches.begin(); it != m_batches.end();) {
+			if(!m_context.is_frame_complete(it->frame)) {
+				++it;
+				continue;
+			}
+
+			for(auto &job : it->jobs) {
+				if(job->req.done) {
+					job->req.done();
+				}
+			}
+
+			{
+				std::lock_guard lock(m_mutex);
+				for(auto &job : it->jobs) {
+					retire_locked(*job, StreamState::Done);
+				}
+			}
+
+			it->jobs.clear();
+			m_freeBatches.push_back(std::move(*it));
+			it = m_batches.erase(it);
+		}
+
+		std::vector<std::shared_ptr<Job>> read;
+		{
+			std::lock_guard lock(m_mutex);
+			for(auto &job : m_read) {
+				if(job->state == StreamState::Cancelled) {
+					retire_locked(*job, StreamState::Cancelled);
+				} else {
+					job->state = StreamState::Uploading;
+					read.push_back(std::move(job));
+				}
+			}
+			m_read.clear();
+		}
+
+		// Staging memory may have been released above
+		m_cv.notify_all();
+		if(read.empty()) {
+			return;
+		}
+
+		// Everything read since the last pump goes out in one command buffer
+		Batch batch;
+		if(m_freeBatches.empty()) {
+			batch.cmd = m_cmdpool->get_buffers(1)[0];
+		} else {
+			batch = std::move(m_freeBatches.back());
+			m_freeBatches.pop_back();
+		}
+
+		check_vk(batch.cmd.reset(), "Failed to reset upload buffer");
+		m_context.begin_cmd(batch.cmd);
+		for(auto &job : read) {
+			job->req.upload(batch.cmd, *job->staging, job->size);
+		}
+		m_context.end_cmd(batch.cmd);
+		m_context.enqueue_gfx(std::span(&batch.cmd, 1));
+		batch.frame = m_context.get_frame_number();
+
+		batch.jobs = std::move(read);
+		m_batches.push_back(std::move(batch));
+	}
+
+	void AssetStreamer::io_thread()
+	{
+		std::unique_lock lock(m_mutex);
+		while(true) {
+			m_cv.wait(lock, [this]() { return m_stop || !m_queue.empty(); });
+			if(m_stop) {
+				return;
+			}
+
+			auto job = m_queue.top();
+			m_queue.pop();
+			if(job->state == StreamState::Cancelled) {
+				continue;
+			}
+
+			job->state = StreamState::Reading;
+			lock.unlock();
+
+			MappedFile file(job->req.path);
+			lock.lock();
+			// Also catches empty files, which can't be mapped
+			if(!file.is_open()) {
+				if(job->state != StreamState::Cancelled) {
+					job->state = StreamState::Failed;
+					m_finished.push_back(job->handle);
+				}
+				continue;
+			}
+
+			// Back pressure: don't read further ahead than the gpu is consuming.
+			// A single file larger than the limit still goes through on its own.
+			m_cv.wait(lock, [this, &file]() {
+				return m_stop || m_bytesInFlight == 0 || m_bytesInFlight + file.size() <= m_maxBytesInFlight;
+			});
+			if(m_stop) {
+				return;
+			}
+
+			if(job->state == StreamState::Cancelled) {
+				continue;
+			}
+
+			job->size = file.size();
+			m_bytesInFlight += job->size;
+			lock.unlock();
+
+			// VMA is internally synchronised, so staging can be created off the main thread.
+			// Touching the mapping here is what actually pulls the file in from disk.
+			auto staging = std::make_unique<TransferBuffer>(m_context, job->size);
+			staging->write(file.get_data().data(), job->size, 0);
+
+			lock.lock();
+			job->staging = std::move(staging);
+			if(job->state == StreamState::Cancelled) {
+				retire_locked(*job, StreamState::Cancelled);
+			} else {
+				m_read.push_back(std::move(job));
+			}
+		}
+	}
+
+	void AssetStreamer::retire_locked(Job &job, StreamState state)
+	{
+		if(job.state != StreamState::Cancelled) {
+			m_finished.push_back(job.handle);
+		}
+
+		job.state = state;
+		m_bytesInFlight -= job.size;
+		job.size = 0;
+		job.staging.reset();
+	}
+}
@@ -0,0 +1,109 @@
+/**
+ * Copyright (c) 2022 Connor Mellon
+ * 
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+#ifndef IDIO_GFX_STREAMER_H
+#define IDIO_GFX_STREAMER_H
+
+namespace idio
+{
+	class Context;
+	class CommandPool;
+
+	using StreamHandle = uint64_t;
+
+	enum class StreamState
+	{
+		Unknown, // Never requested, or finished long enough ago to be forgotten
+		Queued,
+		Reading,
+		Uploading,
+		Done,
+		Failed,
+		Cancelled
+	};
+
+	struct StreamRequest
+	{
+		std::string path;
+		int32_t priority = 0; // Higher is read first
+		// Frame thread from pump(), records the gpu copy out of the filled staging buffer (file bytes start at 0)
+		std::function<void(vk::CommandBuffer cmd, TransferBuffer &staging, size_t size)> upload;
+		// Frame thread from pump(), once the copy has finished on the gpu
+		std::function<void()> done;
+	};
+
+	// Reads files on a background thread straight into staging memory, highest priority first.
+	// Empty files end up Failed, there is nothing to upload and Vulkan has no zero sized buffers.
+	// pump() is called once per frame: every read that finished since the last call is recorded
+	// into one command buffer that rides in the frame's submission, and done callbacks fire once that frame completes.
+	class AssetStreamer
+	{
+	public:
+		explicit AssetStreamer(Context &c, size_t maxBytesInFlight = 256ull * 1024 * 1024);
+		~AssetStreamer();
+		AssetStreamer(const AssetStreamer &o) = delete;
+		AssetStreamer &operator=(const AssetStreamer &o) = delete;
+
+		// request, cancel and get_state are safe to call from any thread
+		StreamHandle request(StreamRequest &&req);
+		// Only possible until the upload has been recorded
+		bool cancel(StreamHandle h);
+		StreamState get_state(StreamHandle h) const;
+
+		// Call from render_packet or tick, the upload rides in that frame's submission. Pumping from
+		// build_packet with a render thread would tag it with a frame that may already have been flushed.
+		void pump();
+	private:
+		struct Job
+		{
+			StreamHandle handle;
+			StreamRequest req;
+			std::unique_ptr<TransferBuffer> staging;
+			size_t size = 0;
+			StreamState state = StreamState::Queued;
+		};
+
+		struct JobOrder
+		{
+			bool operator()(const std::shared_ptr<Job> &a, const std::shared_ptr<Job> &b) const noexcept
+			{
+				// FIFO within a priority
+				return a->req.priority != b->req.priority ? a->req.priority < b->req.priority : a->handle > b->handle;
+			}
+		};
+
+		struct Batch
+		{
+			vk::CommandBuffer cmd;
+			uint64_t frame = 0; // Frame number it was enqueued on
+			std::vector<std::shared_ptr<Job>> jobs;
+		};
+
+		Context &m_context;
+		size_t m_maxBytesInFlight;
+		std::unique_ptr<CommandPool> m_cmdpool;
+		std::vector<Batch> m_batches;
+		std::vector<Batch> m_freeBatches;
+
+		mutable std::mutex m_mutex;
+		std::condition_variable m_cv;
+		std::priority_queue<std::shared_ptr<Job>, std::vector<std::shared_ptr<Job>>, JobOrder> m_queue;
+		std::unordered_map<StreamHandle, std::shared_ptr<Job>> m_jobs;
+		std::vector<std::shared_ptr<Job>> m_read;
+		std::vector<StreamHandle> m_finished; // Forgotten on the next pump
+		StreamHandle m_nextHandle = 1;
+		size_t m_bytesInFlight = 0;
+		bool m_stop = false;
+		std::thread m_thread;
+
+		void io_thread();
+		void retire_locked(Job &job, StreamState state); // Expects m_mutex to be held
+	};
+}
+
+#endif
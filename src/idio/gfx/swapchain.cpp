@@ -7,18 +7,21 @@
  */
 
 #include "pch.hpp"
+#include "buffer.hpp"
+#include "texture.hpp"
 #include "swapchain.hpp"
 
 #include <SDL_vulkan.h>
 
 #include "vkutl.hpp"
+#include "device.hpp"
 #include "context.hpp"
 #include "core/window.hpp"
 
 namespace idio
 {
 	Swapchain::Swapchain(const Context &c, const Window &w) :
-		m_window(w), m_context(c)
+		m_window(w), m_context(c), m_presentWait(c.get_features().presentWait)
 	{
 		VkSurfaceKHR rsurf;
 		if(!SDL_Vulkan_CreateSurface(w, c.get_instance(), &rsurf)) {
@@ -27,9 +30,30 @@ namespace idio
 		}
 		m_surface = rsurf;
 
-		m_imageAvailSems.resize(s_MaxFramesProcessing);
+		// The device was only picked against the main window, others may sit on a display it can't present to
+		const auto &pdev = c.get_physdev();
+		const auto support = pdev.handle.getSurfaceSupportKHR(pdev.gfxQueueFamilyIdx, m_surface);
+		if(support.result != vk::Result::eSuccess || !support.value) {
+			s_EngineLogger->critical("{} can't present to window {}, is it on a display driven by another gpu?",
+				pdev.props.deviceName, w.get_id());
+			Application::crash();
+		}
+
+		// First format usable as a depth attachment, D32 is both precise and the most widely supported
+		constexpr vk::Format depthFormats[] = { vk::Format::eD32Sfloat, vk::Format::eD32SfloatS8Uint, vk::Format::eD24UnormS8Uint };
+		const auto dfit = std::find_if(std::begin(depthFormats), std::end(depthFormats), [&c](vk::Format f) {
+			return static_cast<bool>(c.get_physdev().handle.getFormatProperties(f).optimalTilingFeatures
+				& vk::FormatFeatureFlagBits::eDepthStencilAttachment);
+		});
+		if(dfit == std::end(depthFormats)) {
+			s_EngineLogger->critical("No supported depth format");
+			Application::crash();
+		}
+		m_depthFormat = *dfit;
+
+		m_imageAvailSems.resize(c.get_max_frames_in_flight());
 		vk::SemaphoreCreateInfo sci {};
-		for(uint32_t i = 0; i < s_MaxFramesProcessing; i++) {
+		for(uint32_t i = 0; i < c.get_max_frames_in_flight(); i++) {
 			m_imageAvailSems[i] = check_vk(c.get_device().createSemaphore(sci), "Failed to create image available semaphore");
 		}
 
@@ -38,13 +62,14 @@ namespace idio
 
 	Swapchain::~Swapchain()
 	{
-		for(uint32_t i = 0; i < s_MaxFramesProcessing; i++) {
-			m_context.get_device().destroySemaphore(m_imageAvailSems[i]);
+		for(auto sem : m_imageAvailSems) {
+			m_context.get_device().destroySemaphore(sem);
 		}
 
 		for(auto iv : m_swapchainImageViews) {
 			m_context.get_device().destroyImageView(iv);
 		}
+		m_depth.reset();
 		m_context.get_device().destroySwapchainKHR(m_swapchain);
 		m_context.get_instance().destroySurfaceKHR(m_surface);
 	}
@@ -52,20 +77,32 @@ namespace idio
 	void Swapchain::recreate()
 	{
 		check_vk(m_context.get_device().waitIdle(), "FUCK");
+		count_metric(EngineMetric::SwapchainRecreations);
 		for(auto iv : m_swapchainImageViews) {
 			m_context.get_device().destroyImageView(iv);
 		}
 		create();
 	}
 
+	vk::ImageView Swapchain::get_depth_view() const
+	{
+		return m_depth->get_view();
+	}
+
+	uint32_t Swapchain::get_current_frame_index() const
+	{
+		return m_context.get_frame_index();
+	}
+
 	bool Swapchain::next()
 	{
 		constexpr uint64_t intmax = std::numeric_limits<uint64_t>::max();
-		vk::Fence currentfence = m_context.get_gfx_queue_fences()[m_currentFrame];
-		check_vk(m_context.get_device().waitForFences({ currentfence }, true, intmax),
-			"Got impatient");
+		pace();
 
-		auto imgres = m_context.get_device().acquireNextImageKHR(m_swapchain, intmax, m_imageAvailSems[m_currentFrame]);
+		// Context::begin_frame already waited for this frame's fence
+		const uint32_t frame = get_current_frame_index();
+
+		auto imgres = m_context.get_device().acquireNextImageKHR(m_swapchain, intmax, m_imageAvailSems[frame]);
 		if(imgres.result == vk::Result::eSuboptimalKHR || imgres.result == vk::Result::eErrorOutOfDateKHR) {
 			recreate();
 			return false;
@@ -74,7 +111,6 @@ namespace idio
 			Application::crash();
 		}
 
-		m_context.get_device().resetFences({ currentfence });
 		m_imageIndex = imgres.value;
 		return true;
 	}
@@ -95,19 +131,48 @@ namespace idio
 			m_format = surfformats[0];
 		}
 
+		// FIFO is the only mode every surface has to support
 		auto presentmodes = pdev.getSurfacePresentModesKHR(m_surface).value;
+		auto supported = [&presentmodes](vk::PresentModeKHR m) {
+			return std::find(presentmodes.begin(), presentmodes.end(), m) != presentmodes.end();
+		};
+
+		m_policy = m_window.get_present_policy();
 		m_pmode = vk::PresentModeKHR::eFifo;
-		if(m_window.is_vsync()) {
-			auto pif = std::find(presentmodes.begin(), presentmodes.end(), vk::PresentModeKHR::eMailbox);
-			if(pif != presentmodes.end()) {
-				m_pmode = *pif;
-			} else {
-				s_EngineLogger->warn("VSync was requested but not supported, weird?");
+		switch(m_policy) {
+		case PresentPolicy::Vsync:
+			break;
+		case PresentPolicy::Uncapped:
+			if(supported(vk::PresentModeKHR::eImmediate)) {
+				m_pmode = vk::PresentModeKHR::eImmediate;
+				break;
 			}
+			[[fallthrough]];
+		case PresentPolicy::LowLatency:
+		case PresentPolicy::Capped:
+			if(supported(vk::PresentModeKHR::eMailbox)) {
+				m_pmode = vk::PresentModeKHR::eMailbox;
+			}
+			break;
+		}
+
+		if(m_pmode == vk::PresentModeKHR::eFifo && m_policy != PresentPolicy::Vsync) {
+			s_EngineLogger->warn("Present policy isn't supported by the surface, using vsync");
 		}
 
+		// Mailbox needs a spare image to never block, immediate never waits on one, and fifo only
+		// queues more than the minimum when vsync trades latency for smoothness
 		auto caps = pdev.getSurfaceCapabilitiesKHR(m_surface).value;
-		uint32_t imageCount = caps.minImageCount + 1;
+		uint32_t imageCount = caps.minImageCount;
+		if(m_pmode == vk::PresentModeKHR::eMailbox) {
+			imageCount = std::max(caps.minImageCount + 1, 3u);
+		} else if(m_pmode == vk::PresentModeKHR::eFifo && m_policy == PresentPolicy::Vsync) {
+			imageCount = caps.minImageCount + 1;
+		}
+
+		if(caps.maxImageCount != 0) {
+			imageCount = std::min(imageCount, caps.maxImageCount);
+		}
 		if(caps.currentExtent.width != std::numeric_limits<uint32_t>::max()) {
 			m_extent = caps.currentExtent;
 		} else { // Supporting apple retna despite apple not supporting vulkan... good move :)
@@ -143,9 +208,13 @@ namespace idio
 			m_context.get_device().destroySwapchainKHR(ci.oldSwapchain);
 		}
 
+		m_presentId = 0;
+		s_EngineLogger->debug("Swapchain using {} with {} images", vk::to_string(m_pmode), imageCount);
+
+		// Drivers may create more images than asked for
 		m_swapchainImages = m_context.get_device().getSwapchainImagesKHR(m_swapchain).value;
-		m_swapchainImageViews.resize(imageCount);
-		for(uint32_t i = 0; i < imageCount; i++) {
+		m_swapchainImageViews.resize(m_swapchainImages.size());
+		for(size_t i = 0; i < m_swapchainImages.size(); i++) {
 			vk::ImageViewCreateInfo ici {};
 			ici.image = m_swapchainImages[i];
 			ici.format = m_format.format;
@@ -159,34 +228,77 @@ namespace idio
 			m_swapchainImageViews[i] = check_vk(m_context.get_device().createImageView(ici),
 				"Failed to create swapchain image views");
 		}
+
+		TextureCreateInfo tci {};
+		tci.extent = m_extent;
+		tci.format = m_depthFormat;
+		tci.mipLevels = 1;
+		tci.usage = vk::ImageUsageFlagBits::eDepthStencilAttachment;
+		tci.aspect = vk::ImageAspectFlagBits::eDepth;
+		tci.generateMips = false;
+		m_depth = std::make_unique<Texture>(m_context, tci);
 	}
 
-	void Swapchain::present(const Context &c, std::vector<Swapchain *> &scs)
+	void Swapchain::pace()
 	{
-		std::vector<vk::SwapchainKHR> swaps(scs.size());
-		std::vector<uint32_t> imgidxs(scs.size());
-		std::vector<vk::Semaphore> waitSems(scs.size());
+		// Presents allowed to be waiting for the display when the cpu starts on a new frame
+		uint64_t queued = 0;
+		if(m_policy == PresentPolicy::LowLatency) {
+			queued = 1;
+		} else if(m_policy == PresentPolicy::Vsync) {
+			queued = 2;
+		}
+
+		if(!m_presentWait || queued == 0 || m_presentId <= queued) {
+			return;
+		}
+
+		// Occluded windows may never present, acquire deals with out of date swapchains
+		constexpr uint64_t timeoutNs = 100'000'000;
+		const uint64_t id = m_presentId - queued;
+		auto res = m_context.get_device().waitForPresentKHR(m_swapchain, id, timeoutNs, m_context.get_dispatch());
+		if(res != vk::Result::eSuccess && res != vk::Result::eSuboptimalKHR) {
+			return;
+		}
+
+		const std::chrono::duration<float, std::milli> latency = Clock::now() - m_presentTimes[id % s_PresentHistory];
+		m_presentLatency = m_presentLatency == 0.0f ? latency.count() : glm::mix(m_presentLatency, latency.count(), 0.1f);
+	}
+
+	void Swapchain::present(Context &c, std::span<Swapchain *const> scs)
+	{
+		auto &arena = c.get_frame_arena();
+		auto swaps = arena.alloc<vk::SwapchainKHR>(scs.size());
+		auto imgidxs = arena.alloc<uint32_t>(scs.size());
+		auto presentIds = arena.alloc<uint64_t>(scs.size());
+		const auto now = Clock::now();
 		for(size_t i = 0; i < scs.size(); i++) {
 			const auto sc = scs[i];
 			swaps[i] = sc->m_swapchain;
 			imgidxs[i] = sc->get_current_image_index();
-			waitSems[i] = c.get_gfx_queue_finish_sems()[sc->get_current_frame_index()];
+			presentIds[i] = ++sc->m_presentId;
+			sc->m_presentTimes[sc->m_presentId % s_PresentHistory] = now;
 		}
 
+		vk::PresentIdKHR pid {};
+		pid.swapchainCount = static_cast<uint32_t>(presentIds.size());
+		pid.pPresentIds = presentIds.data();
+
+		// Every swapchain was rendered by the frame's one submission, which signals a single semaphore
+		const vk::Semaphore waitSems[] = { c.get_gfx_queue_finish_sems()[c.get_frame_index()] };
 		vk::PresentInfoKHR pi {};
-		pi.waitSemaphoreCount = static_cast<uint32_t>(waitSems.size());
-		pi.pWaitSemaphores = waitSems.data();
+		pi.waitSemaphoreCount = 1;
+		pi.pWaitSemaphores = waitSems;
 		pi.swapchainCount = static_cast<uint32_t>(swaps.size());
 		pi.pSwapchains = swaps.data();
 		pi.pImageIndices = imgidxs.data();
+		if(c.get_features().presentWait) {
+			pi.pNext = &pid;
+		}
 		vk::Result pres = c.get_gfx_queue().presentKHR(pi); // Let's just hope the resize signal propogates 🙃
 		if(pres != vk::Result::eSuccess && pres != vk::Result::eSuboptimalKHR && pres != vk::Result::eErrorOutOfDateKHR) {
 			s_EngineLogger->critical("Failed to present");
 			Application::crash();
 		}
-
-		for(auto sc : scs) {
-			sc->m_currentFrame = (sc->m_currentFrame + 1) % s_MaxFramesProcessing;
-		}
 	}
-}
+}
\ No newline at end of file
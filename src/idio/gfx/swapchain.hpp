@@ -13,6 +13,7 @@ namespace idio
 {
 	class Window;
 	class Context;
+	class Texture;
 
 	class Swapchain
 	{
@@ -25,12 +26,20 @@ namespace idio
 
 		vk::Extent2D get_extent() const { return m_extent; }
 		vk::Format get_format() const { return m_format.format; }
-		auto get_image_views() const { return m_swapchainImageViews; }
+		std::span<const vk::ImageView> get_image_views() const { return m_swapchainImageViews; }
+		// Shared by every image, passes on the same queue are ordered by their subpass dependencies
+		vk::ImageView get_depth_view() const;
+		vk::Format get_depth_format() const { return m_depthFormat; }
 		uint32_t get_current_image_index() const { return m_imageIndex; }
-		uint32_t get_current_frame_index() const { return m_currentFrame; }
-		auto get_current_image_avail_sem() const { return m_imageAvailSems[m_currentFrame]; }
+		uint32_t get_current_frame_index() const;
+		vk::Semaphore get_current_image_avail_sem() const { return m_imageAvailSems[get_current_frame_index()]; }
+		PresentPolicy get_present_policy() const { return m_policy; }
+		vk::PresentModeKHR get_present_mode() const { return m_pmode; }
+		// Smoothed ms from queueing a present to it reaching the display, 0 without present wait.
+		// Only sampled when pacing waits, so it reads high if the image was already shown.
+		float get_present_latency() const { return m_presentLatency; }
 
-		static void present(const Context &c, std::vector<Swapchain *> &scs);
+		static void present(Context &c, std::span<Swapchain *const> scs);
 	private:
 		const Window &m_window;
 		const Context &m_context;
@@ -40,15 +49,25 @@ namespace idio
 		vk::Extent2D m_extent;
 		vk::PresentModeKHR m_pmode;
 		vk::SurfaceFormatKHR m_format;
+		PresentPolicy m_policy;
+
+		static constexpr uint32_t s_PresentHistory = 8;
+		bool m_presentWait;
+		uint64_t m_presentId = 0; // Last id queued, ids restart with each swapchain
+		std::array<Clock::time_point, s_PresentHistory> m_presentTimes {};
+		float m_presentLatency = 0.0f;
 
-		uint32_t m_currentFrame = 0;
 		std::vector<vk::Semaphore> m_imageAvailSems;
 
 		uint32_t m_imageIndex;
 		std::vector<vk::Image> m_swapchainImages;
 		std::vector<vk::ImageView> m_swapchainImageViews;
 
+		vk::Format m_depthFormat;
+		std::unique_ptr<Texture> m_depth;
+
 		void create();
+		void pace();
 	};
 }
 
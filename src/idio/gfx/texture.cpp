@@ -0,0 +1,269 @@
+/**
+ * Copyright (c) 2022 Connor Mellon
+ * 
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+#include "pch.hpp"
+#include "buffer.hpp"
+#include "texture.hpp"
+
+#include "vkutl.hpp"
+#include "device.hpp"
+#include "context.hpp"
+
+namespace idio
+{
+	namespace
+	{
+		struct LayoutUse
+		{
+			vk::AccessFlags access;
+			vk::PipelineStageFlags stages;
+		};
+
+		LayoutUse layout_use(vk::ImageLayout layout)
+		{
+			using Access = vk::AccessFlagBits;
+			using Stage = vk::PipelineStageFlagBits;
+			switch(layout) {
+			case vk::ImageLayout::eUndefined:
+				return { {}, Stage::eTopOfPipe };
+			case vk::ImageLayout::eTransferDstOptimal:
+				return { Access::eTransferWrite, Stage::eTransfer };
+			case vk::ImageLayout::eTransferSrcOptimal:
+				return { Access::eTransferRead, Stage::eTransfer };
+			case vk::ImageLayout::eShaderReadOnlyOptimal:
+				return { Access::eShaderRead, Stage::eVertexShader | Stage::eFragmentShader | Stage::eComputeShader };
+			case vk::ImageLayout::eColorAttachmentOptimal:
+				return { Access::eColorAttachmentRead | Access::eColorAttachmentWrite, Stage::eColorAttachmentOutput };
+			case vk::ImageLayout::eDepthStencilAttachmentOptimal:
+				return { Access::eDepthStencilAttachmentRead | Access::eDepthStencilAttachmentWrite,
+					Stage::eEarlyFragmentTests | Stage::eLateFragmentTests };
+			case vk::ImageLayout::eGeneral:
+				return { Access::eShaderRead | Access::eShaderWrite, Stage::eFragmentShader | Stage::eComputeShader };
+			default:
+				return { Access::eMemoryRead | Access::eMemoryWrite, Stage::eAllCommands };
+			}
+		}
+	}
+
+	Texture::Texture(const Context &c, const TextureCreateInfo &tci) :
+		m_context(c), m_format(tci.format), m_extent(tci.extent), m_aspect(tci.aspect),
+		m_mipLevels(tci.mipLevels == 0 ? full_mip_count(tci.extent) : tci.mipLevels),
+		m_generateMips(tci.generateMips)
+	{
+		if(m_generateMips && m_mipLevels > 1) {
+			// Mips are blitted down from level 0, which needs linear filtering support for the format
+			const auto fprops = c.get_physdev().handle.getFormatProperties(m_format);
+			constexpr auto blitFeatures = vk::FormatFeatureFlagBits::eBlitSrc | vk::FormatFeatureFlagBits::eBlitDst
+				| vk::FormatFeatureFlagBits::eSampledImageFilterLinear;
+			if((fprops.optimalTilingFeatures & blitFeatures) != blitFeatures) {
+				s_EngineLogger->warn("Format {} can't be blitted, disabling mips", vk::to_string(m_format));
+				m_mipLevels = 1;
+			}
+		}
+
+		vk::ImageCreateInfo ici {};
+		ici.imageType = vk::ImageType::e2D;
+		ici.format = m_format;
+		ici.extent = vk::Extent3D { m_extent.width, m_extent.height, 1 };
+		ici.mipLevels = m_mipLevels;
+		ici.arrayLayers = 1;
+		ici.samples = vk::SampleCountFlagBits::e1;
+		ici.tiling = vk::ImageTiling::eOptimal;
+		ici.usage = tci.usage | vk::ImageUsageFlagBits::eTransferDst;
+		if(m_generateMips && m_mipLevels > 1) {
+			ici.usage |= vk::ImageUsageFlagBits::eTransferSrc;
+		}
+		ici.sharingMode = vk::SharingMode::eExclusive;
+		ici.initialLayout = vk::ImageLayout::eUndefined;
+
+		VmaAllocationCreateInfo aci {};
+		aci.usage = VMA_MEMORY_USAGE_GPU_ONLY;
+
+		VkImage tmpimg;
+		auto rawici = static_cast<VkImageCreateInfo>(ici);
+		check_vk(vmaCreateImage(c.get_allocator(), &rawici, &aci, &tmpimg, &m_alloc, nullptr), "Failed to create image");
+		m_image = static_cast<vk::Image>(tmpimg);
+
+		vk::ImageViewCreateInfo vci {};
+		vci.image = m_image;
+		vci.format = m_format;
+		vci.viewType = vk::ImageViewType::e2D;
+		vci.components = { vk::ComponentSwizzle::eIdentity };
+		vci.subresourceRange.aspectMask = m_aspect;
+		vci.subresourceRange.baseMipLevel = 0;
+		vci.subresourceRange.levelCount = m_mipLevels;
+		vci.subresourceRange.baseArrayLayer = 0;
+		vci.subresourceRange.layerCount = 1;
+		m_view = check_vk(c.get_device().createImageView(vci), "Failed to create image view");
+	}
+
+	Texture::~Texture()
+	{
+		m_context.get_device().destroyImageView(m_view);
+		vmaDestroyImage(m_context.get_allocator(), m_image, m_alloc);
+	}
+
+	void Texture::transition_cmd(vk::CommandBuffer cmd, vk::ImageLayout layout)
+	{
+		if(layout == m_layout) {
+			return;
+		}
+
+		barrier_cmd(cmd, m_layout, layout, 0, m_mipLevels);
+		m_layout = layout;
+	}
+
+	void Texture::upload_cmd(vk::CommandBuffer cmd, TransferBuffer &src, vk::DeviceSize srcOffset)
+	{
+		// Contents are replaced wholesale, no need to preserve them
+		barrier_cmd(cmd, vk::ImageLayout::eUndefined, vk::ImageLayout::eTransferDstOptimal, 0, m_mipLevels);
+		m_layout = vk::ImageLayout::eTransferDstOptimal;
+
+		vk::BufferImageCopy bic {};
+		bic.bufferOffset = srcOffset;
+		bic.imageSubresource.aspectMask = m_aspect;
+		bic.imageSubresource.mipLevel = 0;
+		bic.imageSubresource.baseArrayLayer = 0;
+		bic.imageSubresource.layerCount = 1;
+		bic.imageExtent = vk::Extent3D { m_extent.width, m_extent.height, 1 };
+		cmd.copyBufferToImage(src, m_image, vk::ImageLayout::eTransferDstOptimal, bic);
+
+		if(m_generateMips && m_mipLevels > 1) {
+			generate_mips_cmd(cmd);
+		} else {
+			transition_cmd(cmd, vk::ImageLayout::eShaderReadOnlyOptimal);
+		}
+	}
+
+	void Texture::upload_levels_cmd(vk::CommandBuffer cmd, TransferBuffer &src, std::span<const vk::DeviceSize> levelOffsets)
+	{
+		constexpr uint32_t maxLevels = 16;
+		const uint32_t levels = std::min({ static_cast<uint32_t>(levelOffsets.size()), m_mipLevels, maxLevels });
+
+		barrier_cmd(cmd, vk::ImageLayout::eUndefined, vk::ImageLayout::eTransferDstOptimal, 0, m_mipLevels);
+		m_layout = vk::ImageLayout::eTransferDstOptimal;
+
+		std::array<vk::BufferImageCopy, maxLevels> copies;
+		for(uint32_t i = 0; i < levels; i++) {
+			auto &bic = copies[i];
+			bic.bufferOffset = levelOffsets[i];
+			bic.imageSubresource = vk::ImageSubresourceLayers { m_aspect, i, 0, 1 };
+			bic.imageExtent = vk::Extent3D { std::max(m_extent.width >> i, 1u), std::max(m_extent.height >> i, 1u), 1 };
+		}
+
+		cmd.copyBufferToImage(src, m_image, vk::ImageLayout::eTransferDstOptimal, levels, copies.data());
+		transition_cmd(cmd, vk::ImageLayout::eShaderReadOnlyOptimal);
+	}
+
+	void Texture::generate_mips_cmd(vk::CommandBuffer cmd)
+	{
+		if(m_layout != vk::ImageLayout::eTransferDstOptimal) {
+			s_EngineLogger->warn("Generating mips needs the image in eTransferDstOptimal");
+			return;
+		}
+
+		int32_t w = static_cast<int32_t>(m_extent.width);
+		int32_t h = static_cast<int32_t>(m_extent.height);
+		for(uint32_t i = 1; i < m_mipLevels; i++) {
+			barrier_cmd(cmd, vk::ImageLayout::eTransferDstOptimal, vk::ImageLayout::eTransferSrcOptimal, i - 1, 1);
+
+			vk::ImageBlit blit {};
+			blit.srcSubresource = vk::ImageSubresourceLayers { m_aspect, i - 1, 0, 1 };
+			blit.srcOffsets[1] = vk::Offset3D { w, h, 1 };
+			w = std::max(w / 2, 1);
+			h = std::max(h / 2, 1);
+			blit.dstSubresource = vk::ImageSubresourceLayers { m_aspect, i, 0, 1 };
+			blit.dstOffsets[1] = vk::Offset3D { w, h, 1 };
+			cmd.blitImage(m_image, vk::ImageLayout::eTransferSrcOptimal, m_image, vk::ImageLayout::eTransferDstOptimal,
+				blit, vk::Filter::eLinear);
+
+			// Source level is done with, hand it over to the shaders
+			barrier_cmd(cmd, vk::ImageLayout::eTransferSrcOptimal, vk::ImageLayout::eShaderReadOnlyOptimal, i - 1, 1);
+		}
+
+		barrier_cmd(cmd, vk::ImageLayout::eTransferDstOptimal, vk::ImageLayout::eShaderReadOnlyOptimal, m_mipLevels - 1, 1);
+		m_layout = vk::ImageLayout::eShaderReadOnlyOptimal;
+	}
+
+	uint32_t Texture::full_mip_count(vk::Extent2D extent) noexcept
+	{
+		return static_cast<uint32_t>(std::bit_width(std::max(std::max(extent.width, extent.height), 1u)));
+	}
+
+	void Texture::barrier_cmd(vk::CommandBuffer cmd, vk::ImageLayout from, vk::ImageLayout to, uint32_t baseMip, uint32_t mipCount) const
+	{
+		const auto src = layout_use(from);
+		const auto dst = layout_use(to);
+
+		vk::ImageMemoryBarrier imb {};
+		imb.srcAccessMask = src.access;
+		imb.dstAccessMask = dst.access;
+		imb.oldLayout = from;
+		imb.newLayout = to;
+		imb.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		imb.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		imb.image = m_image;
+		imb.subresourceRange = vk::ImageSubresourceRange { m_aspect, baseMip, mipCount, 0, 1 };
+		cmd.pipelineBarrier(src.stages, dst.stages, {}, nullptr, nullptr, imb);
+	}
+
+	SamplerCache::SamplerCache(const Context &c) :
+		m_context(c)
+	{
+	}
+
+	SamplerCache::~SamplerCache()
+	{
+		for(auto &[desc, sampler] : m_samplers) {
+			m_context.get_device().destroySampler(sampler);
+		}
+	}
+
+	vk::Sampler SamplerCache::get(const SamplerDesc &desc)
+	{
+		if(auto it = m_samplers.find(desc); it != m_samplers.end()) {
+			return it->second;
+		}
+
+		const auto &pdev = m_context.get_physdev();
+		vk::SamplerCreateInfo sci {};
+		sci.magFilter = desc.magFilter;
+		sci.minFilter = desc.minFilter;
+		sci.mipmapMode = desc.mipmapMode;
+		sci.addressModeU = desc.addressU;
+		sci.addressModeV = desc.addressV;
+		sci.addressModeW = desc.addressW;
+		sci.anisotropyEnable = desc.maxAnisotropy >= 1.0f && pdev.features.samplerAnisotropy;
+		sci.maxAnisotropy = std::min(desc.maxAnisotropy, pdev.props.limits.maxSamplerAnisotropy);
+		sci.compareEnable = desc.compareOp.has_value();
+		sci.compareOp = desc.compareOp.value_or(vk::CompareOp::eNever);
+		sci.minLod = 0.0f;
+		sci.maxLod = desc.maxLod;
+		sci.borderColor = vk::BorderColor::eFloatOpaqueBlack;
+
+		auto sampler = check_vk(m_context.get_device().createSampler(sci), "Failed to create sampler");
+		m_samplers.emplace(desc, sampler);
+		return sampler;
+	}
+
+	size_t SamplerCache::DescHash::operator()(const SamplerDesc &d) const noexcept
+	{
+		size_t h = 0;
+		const auto combine = [&h](size_t v) { h ^= v + 0x9e3779b97f4a7c15 + (h << 6) + (h >> 2); };
+		combine(static_cast<size_t>(d.magFilter));
+		combine(static_cast<size_t>(d.minFilter));
+		combine(static_cast<size_t>(d.mipmapMode));
+		combine(static_cast<size_t>(d.addressU));
+		combine(static_cast<size_t>(d.addressV));
+		combine(static_cast<size_t>(d.addressW));
+		combine(std::hash<float> {}(d.maxAnisotropy));
+		combine(std::hash<float> {}(d.maxLod));
+		combine(d.compareOp ? static_cast<size_t>(*d.compareOp) + 1 : 0);
+		return h;
+	}
+}
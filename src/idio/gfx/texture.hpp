@@ -0,0 +1,107 @@
+/**
+ * Copyright (c) 2022 Connor Mellon
+ * 
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+#ifndef IDIO_GFX_TEXTURE_H
+#define IDIO_GFX_TEXTURE_H
+
+namespace idio
+{
+	class Context;
+
+	struct TextureCreateInfo
+	{
+		vk::Extent2D extent {};
+		vk::Format format = vk::Format::eR8G8B8A8Srgb;
+		uint32_t mipLevels = 0; // 0 for a full chain down to 1x1
+		vk::ImageUsageFlags usage = vk::ImageUsageFlagBits::eSampled;
+		vk::ImageAspectFlags aspect = vk::ImageAspectFlagBits::eColor;
+		bool generateMips = true; // Otherwise every level is uploaded, e.g. prebuilt block compressed chains
+	};
+
+	// Device local 2D image with a view covering every mip level.
+	// The layout is tracked for the whole image, so transitions only need the target layout.
+	class Texture
+	{
+	public:
+		Texture(const Context &c, const TextureCreateInfo &tci);
+		~Texture();
+		Texture(const Texture &o) = delete;
+		Texture &operator=(const Texture &o) = delete;
+
+		void transition_cmd(vk::CommandBuffer cmd, vk::ImageLayout layout);
+		// Copies level 0 from src and leaves the image ready for sampling, blitting the
+		// remaining levels down from it when the texture generates its mips
+		void upload_cmd(vk::CommandBuffer cmd, TransferBuffer &src, vk::DeviceSize srcOffset = 0);
+		// Copies one tightly packed level per offset, starting from level 0
+		void upload_levels_cmd(vk::CommandBuffer cmd, TransferBuffer &src, std::span<const vk::DeviceSize> levelOffsets);
+		// Expects every level in eTransferDstOptimal with level 0 filled in
+		void generate_mips_cmd(vk::CommandBuffer cmd);
+
+		vk::Image get_image() const noexcept { return m_image; }
+		vk::ImageView get_view() const noexcept { return m_view; }
+		vk::Format get_format() const noexcept { return m_format; }
+		vk::Extent2D get_extent() const noexcept { return m_extent; }
+		uint32_t get_mip_levels() const noexcept { return m_mipLevels; }
+		vk::ImageLayout get_layout() const noexcept { return m_layout; }
+
+		static uint32_t full_mip_count(vk::Extent2D extent) noexcept;
+	private:
+		const Context &m_context;
+		vk::Image m_image;
+		vk::ImageView m_view;
+		VmaAllocation m_alloc;
+
+		vk::Format m_format;
+		vk::Extent2D m_extent;
+		vk::ImageAspectFlags m_aspect;
+		uint32_t m_mipLevels;
+		bool m_generateMips;
+		vk::ImageLayout m_layout = vk::ImageLayout::eUndefined;
+
+		void barrier_cmd(vk::CommandBuffer cmd, vk::ImageLayout from, vk::ImageLayout to, uint32_t baseMip, uint32_t mipCount) const;
+	};
+
+	struct SamplerDesc
+	{
+		vk::Filter magFilter = vk::Filter::eLinear;
+		vk::Filter minFilter = vk::Filter::eLinear;
+		vk::SamplerMipmapMode mipmapMode = vk::SamplerMipmapMode::eLinear;
+		vk::SamplerAddressMode addressU = vk::SamplerAddressMode::eRepeat;
+		vk::SamplerAddressMode addressV = vk::SamplerAddressMode::eRepeat;
+		vk::SamplerAddressMode addressW = vk::SamplerAddressMode::eRepeat;
+		float maxAnisotropy = 0.0f; // Disabled below 1, clamped to the device limit
+		float maxLod = VK_LOD_CLAMP_NONE;
+		std::optional<vk::CompareOp> compareOp; // Set for shadow map style depth comparisons
+
+		bool operator==(const SamplerDesc &o) const = default;
+	};
+
+	// Samplers are tiny but limited in count (maxSamplerAllocationCount), so
+	// identical descriptions share one handle for the lifetime of the cache.
+	class SamplerCache
+	{
+	public:
+		explicit SamplerCache(const Context &c);
+		~SamplerCache();
+		SamplerCache(const SamplerCache &o) = delete;
+		SamplerCache &operator=(const SamplerCache &o) = delete;
+
+		vk::Sampler get(const SamplerDesc &desc);
+		size_t size() const noexcept { return m_samplers.size(); }
+	private:
+		struct DescHash
+		{
+			size_t operator()(const SamplerDesc &d) const noexcept;
+		};
+
+		const Context &m_context;
+		std::unordered_map<SamplerDesc, vk::Sampler, DescHash> m_samplers;
+	};
+}
+
+#endif
@@ -9,14 +9,24 @@
 #ifndef IDIO_IDIO_H
 #define IDIO_IDIO_H
 
+#include <bit>
 #include <span>
+#include <chrono>
 #include <array>
+#include <deque>
+#include <queue>
+#include <mutex>
+#include <atomic>
+#include <thread>
 #include <tuple>
 #include <string>
 #include <memory>
 #include <vector>
+#include <unordered_map>
 #include <memory>
 #include <utility>
+#include <functional>
+#include <condition_variable>
 #include <iostream>
 #include <optional>
 #include <string_view>
@@ -26,13 +36,28 @@
 #include <vk_mem_alloc.h>
 
 #include <SDL.h>
+#include <glm/glm.hpp>
 #include <spdlog/spdlog.h>
 
 #include "core/app.hpp"
+#include "core/memory.hpp"
+#include "core/metrics.hpp"
+#include "core/packet.hpp"
+#include "core/file.hpp"
 #include "gfx/vkutl.hpp"
+#include "gfx/device.hpp"
 #include "gfx/context.hpp"
 #include "gfx/swapchain.hpp"
 #include "gfx/pipeline.hpp"
 #include "gfx/buffer.hpp"
+#include "gfx/texture.hpp"
+#include "gfx/ktx.hpp"
+#include "gfx/streamer.hpp"
+#include "gfx/quantise.hpp"
+#include "gfx/meshfmt.hpp"
+#include "gfx/mesh.hpp"
+#include "gfx/pool.hpp"
+#include "gfx/budget.hpp"
+#include "gfx/culling.hpp"
 
 #endif
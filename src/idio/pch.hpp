@@ -9,15 +9,25 @@
 #ifndef IDIO_PCH_H
 #define IDIO_PCH_H
 
+#include <bit>
 #include <span>
+#include <chrono>
 #include <array>
+#include <deque>
+#include <queue>
+#include <mutex>
+#include <atomic>
+#include <thread>
 #include <tuple>
 #include <string>
 #include <memory>
 #include <limits>
 #include <vector>
+#include <unordered_map>
 #include <memory>
 #include <utility>
+#include <functional>
+#include <condition_variable>
 #include <optional>
 #include <iostream>
 #include <string_view>
@@ -27,8 +37,11 @@
 #include <vk_mem_alloc.h>
 
 #include <SDL.h>
+#include <glm/glm.hpp>
 #include <spdlog/spdlog.h>
 
 #include "core/app.hpp"
+#include "core/memory.hpp"
+#include "core/metrics.hpp"
 
 #endif
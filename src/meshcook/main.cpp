@@ -0,0 +1,441 @@
+/**
+ * Copyright (c) 2022 Connor Mellon
+ * 
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+// Offline mesh cooker: OBJ in, .idm out.
+// Usage: meshcook <in.obj> <out.idm> [--lods n] [--packed]
+
+#include <bit>
+#include <cmath>
+#include <array>
+#include <string>
+#include <vector>
+#include <limits>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <charconv>
+#include <fstream>
+#include <sstream>
+#include <iostream>
+#include <algorithm>
+#include <string_view>
+#include <unordered_map>
+
+#include <idio/gfx/meshfmt.hpp>
+#include <idio/gfx/quantise.hpp>
+
+using namespace idio;
+
+namespace
+{
+	struct RawMesh
+	{
+		std::vector<MeshVertex> vertices;
+		std::vector<uint32_t> indices;
+	};
+
+	struct ObjKey
+	{
+		int v, vt, vn;
+		bool operator==(const ObjKey &o) const = default;
+	};
+
+	struct ObjKeyHash
+	{
+		size_t operator()(const ObjKey &k) const noexcept
+		{
+			return std::hash<uint64_t> {}((uint64_t(uint32_t(k.v)) << 32) ^ (uint64_t(uint32_t(k.vt)) << 16) ^ uint32_t(k.vn));
+		}
+	};
+
+	// The whole token has to be a number, so "12abc" is rejected rather than read as 12
+	template<typename T>
+	bool parse_number(std::string_view str, T &out)
+	{
+		const auto end = str.data() + str.size();
+		auto [ptr, ec] = std::from_chars(str.data(), end, out);
+		return ec == std::errc {} && ptr == end;
+	}
+
+	// Positions, normals and uvs are deduplicated per unique v/vt/vn triple; polygons are fanned
+	bool load_obj(const std::string &pth, RawMesh &out)
+	{
+		std::ifstream file(pth);
+		if(!file) {
+			std::cerr << "Failed to open " << pth << "\n";
+			return false;
+		}
+
+		std::vector<std::array<float, 3>> pos, nrm;
+		std::vector<std::array<float, 2>> uvs;
+		std::unordered_map<ObjKey, uint32_t, ObjKeyHash> remap;
+		std::vector<uint32_t> poly;
+
+		const auto resolve = [](int idx, size_t count) {
+			return idx < 0 ? static_cast<int>(count) + idx : idx - 1; // OBJ is 1 based, negatives are relative
+		};
+
+		std::string line;
+		while(std::getline(file, line)) {
+			std::istringstream ls(line);
+			std::string tag;
+			ls >> tag;
+			if(tag == "v") {
+				auto &p = pos.emplace_back();
+				ls >> p[0] >> p[1] >> p[2];
+			} else if(tag == "vn") {
+				auto &n = nrm.emplace_back();
+				ls >> n[0] >> n[1] >> n[2];
+			} else if(tag == "vt") {
+				auto &t = uvs.emplace_back();
+				ls >> t[0] >> t[1];
+			} else if(tag == "f") {
+				poly.clear();
+				std::string corner;
+				while(ls >> corner) {
+					ObjKey key { 0, 0, 0 }; // 0 is never a valid OBJ index
+					int *fields[] = { &key.v, &key.vt, &key.vn };
+					size_t field = 0, start = 0;
+					while(field < 3 && start <= corner.size()) {
+						const auto end = std::min(corner.find('/', start), corner.size());
+						if(end > start && !parse_number(std::string_view(corner).substr(start, end - start), *fields[field])) {
+							std::cerr << "Bad face corner " << corner << " in " << pth << "\n";
+							return false;
+						}
+						start = end + 1;
+						field++;
+					}
+
+					key.v = resolve(key.v, pos.size());
+					key.vt = key.vt == 0 ? -1 : resolve(key.vt, uvs.size());
+					key.vn = key.vn == 0 ? -1 : resolve(key.vn, nrm.size());
+					if(key.v < 0 || size_t(key.v) >= pos.size() || size_t(key.vt + 1) > uvs.size() || size_t(key.vn + 1) > nrm.size()) {
+						std::cerr << "Bad face index in " << pth << "\n";
+						return false;
+					}
+
+					auto [it, added] = remap.try_emplace(key, static_cast<uint32_t>(out.vertices.size()));
+					if(added) {
+						MeshVertex v {};
+						std::memcpy(v.pos, pos[size_t(key.v)].data(), sizeof(v.pos));
+						if(key.vn >= 0) {
+							std::memcpy(v.normal, nrm[size_t(key.vn)].data(), sizeof(v.normal));
+						}
+						if(key.vt >= 0) {
+							std::memcpy(v.uv, uvs[size_t(key.vt)].data(), sizeof(v.uv));
+						}
+						out.vertices.push_back(v);
+					}
+					poly.push_back(it->second);
+				}
+
+				for(size_t i = 2; i < poly.size(); i++) {
+					out.indices.insert(out.indices.end(), { poly[0], poly[i - 1], poly[i] });
+				}
+			}
+		}
+
+		return !out.indices.empty();
+	}
+
+	// Forsyth's linear-speed vertex cache optimisation: greedily emits the triangle whose
+	// vertices score highest given an LRU cache model and how many triangles still use them.
+	std::vector<uint32_t> optimise_vertex_cache(const std::vector<uint32_t> &indices, size_t vertexCount)
+	{
+		constexpr int cacheSize = 32;
+		const size_t triCount = indices.size() / 3;
+
+		std::vector<uint32_t> valence(vertexCount, 0);
+		for(auto i : indices) {
+			valence[i]++;
+		}
+
+		std::vector<uint32_t> adjOffset(vertexCount + 1, 0);
+		for(size_t v = 0; v < vertexCount; v++) {
+			adjOffset[v + 1] = adjOffset[v] + valence[v];
+		}
+
+		std::vector<uint32_t> adj(indices.size());
+		std::vector<uint32_t> fill(adjOffset.begin(), adjOffset.end() - 1);
+		for(size_t t = 0; t < triCount; t++) {
+			for(size_t k = 0; k < 3; k++) {
+				adj[fill[indices[t * 3 + k]]++] = static_cast<uint32_t>(t);
+			}
+		}
+
+		std::vector<int> cachePos(vertexCount, -1);
+		const auto vertex_score = [&](uint32_t v) {
+			if(valence[v] == 0) {
+				return -1.0f;
+			}
+
+			float s = 0.0f;
+			const int p = cachePos[v];
+			if(p >= 0) {
+				s = p < 3 ? 0.75f : std::pow(1.0f - float(p - 3) / float(cacheSize - 3), 1.5f);
+			}
+			return s + 2.0f / std::sqrt(float(valence[v]));
+		};
+
+		std::vector<float> vscore(vertexCount);
+		for(uint32_t v = 0; v < vertexCount; v++) {
+			vscore[v] = vertex_score(v);
+		}
+
+		std::vector<float> tscore(triCount);
+		std::vector<bool> emitted(triCount, false);
+		for(size_t t = 0; t < triCount; t++) {
+			tscore[t] = vscore[indices[t * 3]] + vscore[indices[t * 3 + 1]] + vscore[indices[t * 3 + 2]];
+		}
+
+		std::vector<uint32_t> out;
+		out.reserve(indices.size());
+		std::vector<uint32_t> cache, next;
+		size_t best = triCount, scan = 0;
+		for(size_t n = 0; n < triCount; n++) {
+			if(best == triCount) {
+				// Nothing adjacent to the cache left, take the next unused triangle
+				while(emitted[scan]) {
+					scan++;
+				}
+				best = scan;
+			}
+
+			emitted[best] = true;
+			next.clear();
+			for(size_t k = 0; k < 3; k++) {
+				const auto v = indices[best * 3 + k];
+				out.push_back(v);
+				next.push_back(v);
+
+				// Drop the triangle from the vertex's remaining adjacency
+				auto *begin = adj.data() + adjOffset[v];
+				auto *end = begin + valence[v];
+				*std::find(begin, end, static_cast<uint32_t>(best)) = *(end - 1);
+				valence[v]--;
+			}
+
+			for(auto v : cache) {
+				if(std::find(next.begin(), next.begin() + 3, v) == next.begin() + 3) {
+					next.push_back(v);
+				}
+			}
+
+			// Vertices pushed out of the cache lose their cache bonus too
+			for(size_t i = 0; i < next.size(); i++) {
+				cachePos[next[i]] = i < cacheSize ? int(i) : -1;
+				vscore[next[i]] = vertex_score(next[i]);
+			}
+
+			if(next.size() > cacheSize) {
+				next.resize(cacheSize);
+			}
+			std::swap(cache, next);
+
+			best = triCount;
+			float bestScore = -1.0f;
+			for(auto v : cache) {
+				for(uint32_t a = adjOffset[v]; a < adjOffset[v] + valence[v]; a++) {
+					const auto t = adj[a];
+					tscore[t] = vscore[indices[t * 3]] + vscore[indices[t * 3 + 1]] + vscore[indices[t * 3 + 2]];
+					if(tscore[t] > bestScore) {
+						bestScore = tscore[t];
+						best = t;
+					}
+				}
+			}
+		}
+
+		return out;
+	}
+
+	// Simplifies by snapping vertices to a grid and keeping the first vertex that lands in each cell.
+	// Cheap and topology agnostic, which suits distant lods.
+	std::vector<uint32_t> cluster_lod(const RawMesh &m, float cellSize, const float *origin)
+	{
+		std::unordered_map<uint64_t, uint32_t> cells;
+		std::vector<uint32_t> rep(m.vertices.size());
+		for(uint32_t i = 0; i < m.vertices.size(); i++) {
+			uint64_t key = 0;
+			for(int a = 0; a < 3; a++) {
+				const auto c = static_cast<uint64_t>((m.vertices[i].pos[a] - origin[a]) / cellSize) & 0x1FFFFF;
+				key = (key << 21) | c;
+			}
+			rep[i] = cells.try_emplace(key, i).first->second;
+		}
+
+		std::vector<uint32_t> out;
+		for(size_t t = 0; t < m.indices.size(); t += 3) {
+			const uint32_t a = rep[m.indices[t]], b = rep[m.indices[t + 1]], c = rep[m.indices[t + 2]];
+			if(a != b && b != c && a != c) {
+				out.insert(out.end(), { a, b, c });
+			}
+		}
+
+		return out;
+	}
+
+	// Reorders vertices by first use so fetches walk memory linearly, remapping every index list
+	void optimise_vertex_fetch(RawMesh &m, std::vector<std::vector<uint32_t>> &lods)
+	{
+		constexpr auto unused = std::numeric_limits<uint32_t>::max();
+		std::vector<uint32_t> remap(m.vertices.size(), unused);
+		std::vector<MeshVertex> vertices;
+		vertices.reserve(m.vertices.size());
+		for(auto &lod : lods) {
+			for(auto &i : lod) {
+				if(remap[i] == unused) {
+					remap[i] = static_cast<uint32_t>(vertices.size());
+					vertices.push_back(m.vertices[i]);
+				}
+				i = remap[i];
+			}
+		}
+
+		m.vertices = std::move(vertices); // Vertices no lod references are dropped
+	}
+}
+
+int main(int argc, char **argv)
+{
+	if(argc < 3) {
+		std::cerr << "Usage: meshcook <in.obj> <out.idm> [--lods n] [--packed]\n";
+		return EXIT_FAILURE;
+	}
+
+	uint32_t maxLods = 4;
+	bool packed = false;
+	for(int i = 3; i < argc; i++) {
+		const std::string arg = argv[i];
+		if(arg == "--lods" && i + 1 < argc) {
+			if(!parse_number(argv[++i], maxLods)) {
+				std::cerr << "Bad lod count " << argv[i] << "\n";
+				std::cerr << "Usage: meshcook <in.obj> <out.idm> [--lods n] [--packed]\n";
+				return EXIT_FAILURE;
+			}
+			maxLods = std::clamp<uint32_t>(maxLods, 1, k_MeshMaxLods);
+		} else if(arg == "--packed") {
+			packed = true;
+		} else {
+			std::cerr << "Unknown option " << arg << "\n";
+			return EXIT_FAILURE;
+		}
+	}
+
+	RawMesh mesh;
+	if(!load_obj(argv[1], mesh)) {
+		return EXIT_FAILURE;
+	}
+
+	float lo[3] = { INFINITY, INFINITY, INFINITY }, hi[3] = { -INFINITY, -INFINITY, -INFINITY };
+	for(const auto &v : mesh.vertices) {
+		for(int a = 0; a < 3; a++) {
+			lo[a] = std::min(lo[a], v.pos[a]);
+			hi[a] = std::max(hi[a], v.pos[a]);
+		}
+	}
+
+	float sphere[4] = { (lo[0] + hi[0]) * 0.5f, (lo[1] + hi[1]) * 0.5f, (lo[2] + hi[2]) * 0.5f, 0.0f };
+	for(const auto &v : mesh.vertices) {
+		const float dx = v.pos[0] - sphere[0], dy = v.pos[1] - sphere[1], dz = v.pos[2] - sphere[2];
+		sphere[3] = std::max(sphere[3], std::sqrt(dx * dx + dy * dy + dz * dz));
+	}
+
+	// Each lod halves the grid resolution, starting from 1/64th of the largest extent
+	std::vector<std::vector<uint32_t>> lods { mesh.indices };
+	std::vector<float> errors { 0.0f };
+	const float extent = std::max({ hi[0] - lo[0], hi[1] - lo[1], hi[2] - lo[2], 1e-6f });
+	float cell = extent / 64.0f;
+	while(lods.size() < maxLods && cell <= extent) {
+		auto lod = cluster_lod(mesh, cell, lo);
+		if(lod.empty()) {
+			break;
+		}
+
+		// Grid sizes that barely remove anything aren't worth a lod
+		if(lod.size() * 10 <= lods.back().size() * 9) {
+			lods.push_back(std::move(lod));
+			errors.push_back(cell / std::max(sphere[3], 1e-6f));
+		}
+		cell *= 2.0f;
+	}
+
+	for(auto &lod : lods) {
+		lod = optimise_vertex_cache(lod, mesh.vertices.size());
+	}
+	optimise_vertex_fetch(mesh, lods);
+
+	MeshFileHeader hdr {};
+	hdr.vertexCount = static_cast<uint32_t>(mesh.vertices.size());
+	hdr.lodCount = static_cast<uint32_t>(lods.size());
+	std::memcpy(hdr.sphere, sphere, sizeof(sphere));
+
+	std::vector<uint32_t> indices;
+	for(size_t i = 0; i < lods.size(); i++) {
+		hdr.lods[i].firstIndex = static_cast<uint32_t>(indices.size());
+		hdr.lods[i].indexCount = static_cast<uint32_t>(lods[i].size());
+		hdr.lods[i].error = errors[i];
+		indices.insert(indices.end(), lods[i].begin(), lods[i].end());
+	}
+	hdr.indexCount = static_cast<uint32_t>(indices.size());
+
+	std::vector<char> vdata, idata;
+	if(packed) {
+		hdr.vertexFormat = MeshVertexFormat::Packed;
+		hdr.vertexStride = sizeof(MeshVertexPacked);
+		vdata.resize(mesh.vertices.size() * sizeof(MeshVertexPacked));
+		for(size_t i = 0; i < mesh.vertices.size(); i++) {
+			const auto &v = mesh.vertices[i];
+			const MeshVertexPacked p {
+				{ quantise_half(v.pos[0]), quantise_half(v.pos[1]), quantise_half(v.pos[2]), quantise_half(1.0f) },
+				pack_snorm_1010102(v.normal[0], v.normal[1], v.normal[2]),
+				{ quantise_half(v.uv[0]), quantise_half(v.uv[1]) }
+			};
+			std::memcpy(vdata.data() + i * sizeof(p), &p, sizeof(p));
+		}
+	} else {
+		vdata.resize(mesh.vertices.size() * sizeof(MeshVertex));
+		std::memcpy(vdata.data(), mesh.vertices.data(), vdata.size());
+	}
+
+	// 0xFFFF is left free so meshes stay usable with primitive restart
+	if(hdr.vertexCount < 0xFFFF) {
+		hdr.indexSize = 2;
+		idata.resize(indices.size() * sizeof(uint16_t));
+		for(size_t i = 0; i < indices.size(); i++) {
+			const auto idx = static_cast<uint16_t>(indices[i]);
+			std::memcpy(idata.data() + i * sizeof(idx), &idx, sizeof(idx));
+		}
+	} else {
+		idata.resize(indices.size() * sizeof(uint32_t));
+		std::memcpy(idata.data(), indices.data(), idata.size());
+	}
+
+	const auto align = [](uint64_t v) { return (v + k_MeshDataAlignment - 1) / k_MeshDataAlignment * k_MeshDataAlignment; };
+	hdr.vertexOffset = sizeof(MeshFileHeader);
+	hdr.indexOffset = align(hdr.vertexOffset + vdata.size());
+
+	std::ofstream out(argv[2], std::ios::binary);
+	if(!out) {
+		std::cerr << "Failed to open " << argv[2] << " for writing\n";
+		return EXIT_FAILURE;
+	}
+
+	const char zeros[k_MeshDataAlignment] = {};
+	out.write(reinterpret_cast<const char *>(&hdr), sizeof(hdr));
+	out.write(vdata.data(), std::streamsize(vdata.size()));
+	out.write(zeros, std::streamsize(hdr.indexOffset - (hdr.vertexOffset + vdata.size())));
+	out.write(idata.data(), std::streamsize(idata.size()));
+
+	std::cout << argv[2] << ": " << hdr.vertexCount << " vertices, " << hdr.lodCount << " lods (";
+	for(size_t i = 0; i < lods.size(); i++) {
+		std::cout << (i ? ", " : "") << lods[i].size() / 3;
+	}
+	std::cout << " triangles)\n";
+	return out ? EXIT_SUCCESS : EXIT_FAILURE;
+}
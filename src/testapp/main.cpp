@@ -21,18 +21,30 @@ struct Vertex
 		pos(x, y), col(r, g, b) {}
 };
 
+struct FrameUniforms
+{
+	glm::vec4 tint;
+};
+
+struct Scene
+{
+	FrameUniforms uniforms;
+	glm::vec2 offset;
+};
+
 class App : public Application
 {
 public:
-	App(std::string name, Version v, const WindowCreateInfo &wci) :
+	App(std::string name, Version v, const WindowCreateInfo &wci, bool renderThread) :
 		Application(name, v, wci)
 	{
+		m_renderThread = renderThread;
+		m_simRate = 30;
 	}
 
 	~App()
 	{
 		check_vk(m_context->get_device().waitIdle(), "Got impatient?");
-		m_context->get_device().destroyFence(m_fence);
 	}
 protected:
 	void init()
@@ -47,6 +59,8 @@ protected:
 		PipelineCreateInfo pci {};
 		pci.vertexShaderCode = *vscode;
 		pci.fragmentShaderCode = *fscode;
+		pci.depthTest = true;
+		pci.depthWrite = true;
 
 		pci.vertexLayouts = {
 			VertexLayout {
@@ -70,53 +84,66 @@ protected:
 			}
 		};
 
+		m_uniforms = std::make_unique<UniformRing>(*m_context, 64 * 1024);
+		pci.setLayouts = { m_uniforms->get_layout() };
+		pci.pushConstantRanges = {
+			vk::PushConstantRange { vk::ShaderStageFlagBits::eVertex, 0, sizeof(glm::vec2) }
+		};
+
 		m_pipeline = std::make_unique<Pipeline>(m_context->get_device(),
 			m_mainWindow->get_swapchain(), pci);
 
 		m_cmdpool = std::make_unique<CommandPool>(*m_context);
-		m_cmdbufs = m_cmdpool->get_buffers(s_MaxFramesProcessing);
-
-		const std::vector<Vertex> verts {
-			{ 0.5f, -0.5f, 1.0f, 0.0f, 0.0f },
-			{ 0.5f, 0.5f, 1.0f, 1.0f, 0.0f },
-			{ -0.5f, -0.5f, 1.0f, 1.0f, 1.0f }
-		};
+		m_cmdbufs = m_cmdpool->get_buffers(m_context->get_max_frames_in_flight());
 
-		m_vbuf = std::make_shared<VertexBuffer<BufferUse::Gpu>>(*m_context, sizeof(Vertex) * 3);
-		m_stagevbuf = std::make_shared<VertexBuffer<BufferUse::Staging>>(*m_context, sizeof(Vertex) * 3);
-		m_stagevbuf->write(verts.data(), sizeof(Vertex) * 3, 0);
+		m_vbuf = std::make_shared<DynamicVertexBuffer>(*m_context, sizeof(Vertex) * 3);
+	}
 
-		vk::FenceCreateInfo fci {};
-		m_fence = check_vk(m_context->get_device().createFence(fci), "Aye");
+	void fixed_tick(float dt)
+	{
+		m_prevAngle = m_angle;
+		m_angle += dt;
+	}
 
-		m_transferbuf = m_cmdpool->get_buffers(1)[0];
-		m_context->begin_cmd(m_transferbuf);
-		m_vbuf->copy_from(m_transferbuf, *m_stagevbuf, sizeof(Vertex) * 3, 0, 0);
-		m_context->end_cmd(m_transferbuf);
-		m_context->submit_gfx_queue({ m_transferbuf }, m_fence);
+	void build_packet(FramePacket &p)
+	{
+		// Simulated at 30hz, drawn smoothly at whatever the display runs at
+		const float angle = glm::mix(m_prevAngle, m_angle, p.get_alpha());
+		auto &scene = p.set_root<Scene>();
+		scene.uniforms.tint = glm::vec4(1.0f, 0.8f, 0.8f, 1.0f);
+		scene.offset = glm::vec2(std::cos(angle), std::sin(angle)) * 0.1f;
 	}
 
-	void tick()
+	void render_packet(const FramePacket &p)
 	{
-		check_vk(m_context->get_device().waitForFences(m_fence, true, 1000000), "Wait");
-		check_vk(m_context->get_device().resetFences(m_fence), "Aye");
+		const auto &scene = p.get_root<Scene>();
+
+		// Rewritten every frame, the other frames in flight keep reading their own copies
+		const Vertex verts[] = {
+			{ 0.5f, -0.5f, 1.0f, 0.0f, 0.0f },
+			{ 0.5f, 0.5f, 0.0f, 0.0f, 0.0f },
+			{ -0.5f, -0.5f, 1.0f, 1.0f, 1.0f }
+		};
+		m_vbuf->write(verts, sizeof(verts), 0);
+
+		auto frame = m_mainWindow->get_swapchain().get_current_frame_index();
+		m_uniforms->begin_frame(frame);
+		auto frameUniforms = m_uniforms->push(scene.uniforms);
 
-		auto cmdbuf = m_cmdbufs[m_mainWindow->get_swapchain().get_current_frame_index()];
+		auto cmdbuf = m_cmdbufs[frame];
 		cmdbuf.reset();
 		m_context->begin_cmd(cmdbuf);
 		m_pipeline->bind_cmd(cmdbuf);
-		VertexBuffer<BufferUse::Gpu>::bind(cmdbuf, { m_vbuf }, { 0 });
+		const vk::DescriptorSet sets[] = { m_uniforms->get_set() };
+		const uint32_t offsets[] = { frameUniforms.offset };
+		m_pipeline->bind_sets_cmd(cmdbuf, 0, sets, offsets);
+		m_pipeline->push_constants_cmd(cmdbuf, vk::ShaderStageFlagBits::eVertex, scene.offset);
+		const vk::DeviceSize vboffsets[] = { 0 };
+		DynamicVertexBuffer::bind(cmdbuf, std::span(&m_vbuf, 1), vboffsets);
 		m_context->draw_cmd(cmdbuf, 3);
 		m_pipeline->unbind_cmd(cmdbuf);
 		m_context->end_cmd(cmdbuf);
-		m_context->submit_gfx_queue(m_mainWindow->get_swapchain(), { cmdbuf });
-
-		Vertex v { 0.5f, 0.5f, 0.0f, 0.0f, 0.0f };
-		m_stagevbuf->write(&v, sizeof(Vertex), sizeof(Vertex));
-		m_context->submit_gfx_queue({ m_transferbuf }, m_fence);
-
-		static std::vector<Swapchain *> scs { &m_mainWindow->get_swapchain() };
-		Swapchain::present(*m_context, scs);
+		submit_frame(std::span(&cmdbuf, 1));
 	}
 
 	void recreate_pipelines()
@@ -131,20 +158,24 @@ protected:
 			[](const QuitEvent &qe) -> bool { return true; },
 			[](const WindowClosedEvent &ce) -> bool { return true; },
 			[](const WindowResizeEvent &re) -> bool { return true; },
-			[](const WindowMinimiseEvent &me) -> bool { return true; });
+			[](const WindowMinimiseEvent &me) -> bool { return true; },
+			[](const WindowFocusEvent &fe) -> bool { return true; });
 	}
 private:
-	vk::Fence m_fence;
-	std::shared_ptr<VertexBuffer<BufferUse::Gpu>> m_vbuf;
-	std::shared_ptr<VertexBuffer<BufferUse::Staging>> m_stagevbuf;
+	float m_angle = 0.0f;
+	float m_prevAngle = 0.0f;
+
+	std::shared_ptr<DynamicVertexBuffer> m_vbuf;
 
-	vk::CommandBuffer m_transferbuf;
 	std::unique_ptr<Pipeline> m_pipeline;
+	std::unique_ptr<UniformRing> m_uniforms;
 	std::unique_ptr<CommandPool> m_cmdpool;
 	std::vector<vk::CommandBuffer> m_cmdbufs;
 };
 
 Application *idio::make_application(std::span<char *> cmdargs)
 {
-	return new App("Hello", Version { 0, 0, 1 }, WindowCreateInfo { .resizeable = true });
+	const bool renderThread = std::find_if(cmdargs.begin(), cmdargs.end(),
+		[](const char *a) { return std::string_view(a) == "--render-thread"; }) != cmdargs.end();
+	return new App("Hello", Version { 0, 0, 1 }, WindowCreateInfo { .resizeable = true }, renderThread);
 }
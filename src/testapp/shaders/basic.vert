@@ -11,7 +11,18 @@ layout(location = 1)in vec3 colour;
 
 layout(location = 0)out vec3 pass_colour;
 
+layout(set = 0, binding = 0)uniform Frame {
+    vec4 tint;
+} frame;
+
+layout(push_constant)uniform Push {
+    vec2 offset;
+} pc;
+
+// Keeps depth identical if this shader is shared with a depth prepass
+invariant gl_Position;
+
 void main() {
-    gl_Position = vec4(pos.xy, 0.0, 1.0);
-    pass_colour = colour;
+    gl_Position = vec4(pos.xy + pc.offset, 0.0, 1.0);
+    pass_colour = colour * frame.tint.rgb;
 }
\ No newline at end of file